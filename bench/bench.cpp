@@ -0,0 +1,60 @@
+#include <string.h>
+#include <stdlib.h>
+#include "bench.h"
+
+extern void bench_await(const bench_options& options);
+extern void bench_yield(const bench_options& options);
+extern void bench_parallel(const bench_options& options);
+
+// bench [--quick] [--max-population N] [await|yield|parallel]
+int main(int argc, char* argv[])
+{
+    bench_options options;
+    bool run_await = true;
+    bool run_yield = true;
+    bool run_parallel = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            options.quick = true;
+            options.max_population = 10000;
+        }
+        else if (strcmp(argv[i], "--max-population") == 0 && i + 1 < argc)
+        {
+            options.max_population = (size_t)strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "await") == 0)
+        {
+            run_yield = false;
+            run_parallel = false;
+        }
+        else if (strcmp(argv[i], "yield") == 0)
+        {
+            run_await = false;
+            run_parallel = false;
+        }
+        else if (strcmp(argv[i], "parallel") == 0)
+        {
+            run_await = false;
+            run_yield = false;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--max-population N] [await|yield|parallel]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (run_await)
+        bench_await(options);
+
+    if (run_yield)
+        bench_yield(options);
+
+    if (run_parallel)
+        bench_parallel(options);
+
+    return 0;
+}
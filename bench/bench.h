@@ -0,0 +1,89 @@
+﻿#pragma once
+/*
+	基准测试公共部分
+	每项结果输出一行json，便于脚本收集和对比
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+
+#if defined _WIN64
+#include <Windows.h>
+#include <Psapi.h>
+#endif
+
+#if defined __linux__
+#include <unistd.h>
+#endif
+
+struct bench_options
+{
+	// 缩小规模，用于快速回归
+	bool quick{ false };
+	// update耗时测试的最大挂起协程数
+	size_t max_population{ 1000000 };
+};
+
+class bench_timer
+{
+public:
+	bench_timer() : start(std::chrono::steady_clock::now())
+	{
+	}
+
+	double elapsed_ns() const
+	{
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+// 输出一项结果，ops为被测操作的次数
+inline void bench_report(const char* name, const char* flavour, size_t population, size_t ops, double total_ns)
+{
+	double ns_per_op = ops > 0 ? total_ns / (double)ops : 0.0;
+	double ops_per_ns = total_ns > 0.0 ? (double)ops / total_ns : 0.0;
+
+	printf("{\"bench\":\"%s\",\"flavour\":\"%s\",\"population\":%zu,\"ops\":%zu,\"total_ns\":%.0f,\"ns_per_op\":%.3f,\"ops_per_ns\":%.3f,\"ops_per_sec\":%.0f}\n",
+		name, flavour, population, ops, total_ns, ns_per_op, ops_per_ns, ops_per_ns * 1e9);
+	fflush(stdout);
+}
+
+// frame_bytes为协程帧本身，resident_bytes为进程内存增量(含管理器中的记录，受内存复用影响只作参考)
+inline void bench_report_memory(const char* name, const char* flavour, size_t population, double frame_bytes, double resident_bytes)
+{
+	printf("{\"bench\":\"%s\",\"flavour\":\"%s\",\"population\":%zu,\"frame_bytes\":%.1f,\"resident_bytes\":%.1f}\n",
+		name, flavour, population, frame_bytes, resident_bytes);
+	fflush(stdout);
+}
+
+// 进程常驻内存，取不到时返回0
+inline size_t bench_resident_bytes()
+{
+#if defined __linux__
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == nullptr)
+		return 0;
+
+	unsigned long pages = 0;
+	unsigned long resident = 0;
+	if (fscanf(file, "%lu %lu", &pages, &resident) != 2)
+		resident = 0;
+
+	fclose(file);
+
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#elif defined _WIN64
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+
+	return (size_t)counters.WorkingSetSize;
+#else
+	return 0;
+#endif
+}
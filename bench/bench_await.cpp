@@ -0,0 +1,390 @@
+﻿#include <vector>
+#include <memory>
+#include "bench.h"
+#include "../include/coroutine_await.h"
+
+using namespace coroutine_await;
+
+coroutine_manager* coroutine_manager::instance = nullptr;
+
+namespace
+{
+    const char* flavour = "await";
+
+    coroutine_t bench_empty()
+    {
+        co_return;
+    }
+
+    coroutine_t bench_park_frame()
+    {
+        co_await wait_for_frame();
+    }
+
+    coroutine_t bench_loop_frame(const bool* stop)
+    {
+        while (!*stop)
+            co_await wait_for_frame();
+    }
+
+    coroutine_t bench_park_seconds(float seconds)
+    {
+        co_await wait_for_seconds(seconds);
+    }
+
+    task<size_t> bench_task_depth(size_t depth)
+    {
+        if (depth == 0)
+            co_return 0;
+
+        size_t value = co_await bench_task_depth(depth - 1);
+        co_return value + 1;
+    }
+
+    coroutine_t bench_await_task(size_t depth, size_t* result)
+    {
+        *result = co_await bench_task_depth(depth);
+    }
+
+    coroutine_t bench_loop_event(int event_id, const bool* stop, size_t* received)
+    {
+        while (!*stop)
+        {
+            std::optional<int> value = co_await wait_for_event<int>(event_id, 1000000.0f);
+            if (value)
+                ++*received;
+        }
+    }
+
+    // 只实现can_resume的自定义等待，每次update轮询
+    class poll_for_ticks : public awaitable
+    {
+    public:
+        poll_for_ticks(uint64_t _ticks) : ticks(_ticks)
+        {
+        }
+
+        virtual bool can_resume() override
+        {
+            return awaitable::get_tick() >= until;
+        }
+
+        bool await_ready()
+        {
+            return false;
+        }
+
+        void await_suspend(coroutine_t::handle_type _awaiting_handle)
+        {
+            awaitable::on_suspend(_awaiting_handle);
+            until = awaitable::get_tick() + ticks;
+        }
+
+        void await_resume()
+        {
+        }
+
+    private:
+        uint64_t ticks;
+        uint64_t until{ 0 };
+    };
+
+    coroutine_t bench_park_polling(uint64_t ticks)
+    {
+        co_await poll_for_ticks(ticks);
+    }
+
+    coroutine_t bench_join_group(uint64_t* coroutines, size_t count)
+    {
+        co_await wait_for_coroutine_group(coroutines, count);
+    }
+
+    std::unique_ptr<coroutine_manager> make_manager(uint64_t& tick)
+    {
+        tick = 1;
+        return std::make_unique<coroutine_manager>(tick);
+    }
+
+    void destroy_all(coroutine_manager& manager, const std::vector<uint64_t>& coroutines)
+    {
+        for (uint64_t id : coroutines)
+            manager.destroy_coroutine(id);
+    }
+
+    // create_coroutine到第一次挂起的开销，以及立即结束的协程
+    void bench_spawn(size_t count)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+
+        bench_timer timer;
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_frame()));
+        bench_report("spawn_parked", flavour, count, count, timer.elapsed_ns());
+
+        manager->update(++tick);
+
+        bench_timer empty_timer;
+        for (size_t i = 0; i < count; i++)
+            manager->create_coroutine(bench_empty());
+        bench_report("spawn_complete", flavour, count, count, empty_timer.elapsed_ns());
+    }
+
+    // 每帧恢复一次的协程，统计单次恢复的平均开销
+    void bench_resume(size_t count, size_t frames)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        bool stop = false;
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_loop_frame(&stop)));
+
+        bench_timer timer;
+        for (size_t i = 0; i < frames; i++)
+            manager->update(++tick);
+        bench_report("resume", flavour, count, count * frames, timer.elapsed_ns());
+
+        stop = true;
+        manager->update(++tick);
+        destroy_all(*manager, coroutines);
+    }
+
+    // 大量协程长时间挂起时，空转update的开销
+    void bench_update_idle(size_t population, size_t frames)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(population);
+        for (size_t i = 0; i < population; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_seconds(1000000.0f + (float)(i % 1000))));
+
+        bench_timer timer;
+        for (size_t i = 0; i < frames; i++)
+            manager->update(++tick);
+        bench_report("update_idle", flavour, population, frames, timer.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // 轮询模式下每次update逐个调用can_resume，统计每个槽位的检查开销
+    void bench_update_polling(size_t population, size_t frames)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(population);
+        for (size_t i = 0; i < population; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_polling(1000000000)));
+
+        bench_timer timer;
+        for (size_t i = 0; i < frames; i++)
+            manager->update(++tick);
+        bench_report("update_polling", flavour, population, population * frames, timer.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // 扫描模式下每次update扫描槽位表的deadline列
+    void bench_update_scan(size_t population, size_t frames)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+        manager->set_timer_mode(timer_mode::scan);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(population);
+        for (size_t i = 0; i < population; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_seconds(1000000.0f + (float)(i % 1000))));
+
+        bench_timer timer;
+        for (size_t i = 0; i < frames; i++)
+            manager->update(++tick);
+        bench_report("update_scan", flavour, population, population * frames, timer.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // 单独比较deadline扫描的标量实现和当前cpu上的向量实现
+    void bench_deadline_scan(size_t population, size_t rounds)
+    {
+        std::vector<uint64_t> deadlines(population);
+        for (size_t i = 0; i < population; i++)
+            deadlines[i] = (i % 97 == 0) ? 0 : 1000000 + i;
+
+        std::vector<uint32_t> expired;
+        expired.reserve(population);
+
+        bench_timer scalar_timer;
+        for (size_t i = 0; i < rounds; i++)
+        {
+            expired.clear();
+            coroutine_scan::scan_scalar(deadlines.data(), deadlines.size(), 1, expired);
+        }
+        bench_report("deadline_scan", "scalar", population, population * rounds, scalar_timer.elapsed_ns());
+
+        bench_timer vector_timer;
+        for (size_t i = 0; i < rounds; i++)
+        {
+            expired.clear();
+            coroutine_scan::scan_expired(deadlines.data(), deadlines.size(), 1, expired);
+        }
+        bench_report("deadline_scan", coroutine_scan::get_scan_isa(), population, population * rounds, vector_timer.elapsed_ns());
+    }
+
+    // count个等待者各收到rounds次事件，统计单次投递的开销
+    void bench_fan_out(size_t count, size_t rounds)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        bool stop = false;
+        size_t received = 0;
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_loop_event(1, &stop, &received)));
+
+        int value = 1;
+
+        bench_timer timer;
+        while (received < count * rounds)
+            manager->trigger_event(1, &value);
+        bench_report("trigger_fan_out", flavour, count, received, timer.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // count个值各交给一个等待者，逐个触发和批量触发对比
+    void bench_one_shot(size_t count, size_t rounds)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        bool stop = false;
+        size_t received = 0;
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_loop_event(1, &stop, &received)));
+
+        std::vector<int> values(count, 1);
+
+        bench_timer single;
+        for (size_t round = 0; round < rounds; round++)
+        {
+            for (size_t i = 0; i < count; i++)
+                manager->trigger_event(1, values[i], delivery::one_shot());
+        }
+        bench_report("trigger_one_shot", flavour, count, received, single.elapsed_ns());
+
+        received = 0;
+
+        bench_timer batch;
+        for (size_t round = 0; round < rounds; round++)
+            manager->trigger_events(1, values.data(), values.size());
+        bench_report("trigger_batch", flavour, count, received, batch.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // depth层嵌套的task，每层一次对称转移进入、一次返回
+    void bench_task_chain(size_t depth, size_t rounds)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        size_t result = 0;
+
+        bench_timer timer;
+        for (size_t round = 0; round < rounds; round++)
+            manager->create_coroutine(bench_await_task(depth, &result));
+        bench_report("task_chain", flavour, depth, depth * rounds, timer.elapsed_ns());
+    }
+
+    // count个子协程下一帧结束，父协程等待全部完成
+    void bench_group_join(size_t count, size_t rounds)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> children(count);
+
+        double total = 0.0;
+        for (size_t round = 0; round < rounds; round++)
+        {
+            bench_timer timer;
+
+            for (size_t i = 0; i < count; i++)
+                children[i] = manager->create_coroutine(bench_park_frame());
+
+            uint64_t parent = manager->create_coroutine(bench_join_group(children.data(), children.size()));
+
+            while (manager->exists_coroutine(parent))
+                manager->update(++tick);
+
+            total += timer.elapsed_ns();
+        }
+        bench_report("group_join", flavour, count, count * rounds, total);
+    }
+
+    // 每个挂起协程占用的内存
+    void bench_memory(size_t population)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(population);
+
+        int64_t frames_before = coroutine_pool::frame_pool::get_stats().bytes_in_use;
+        size_t before = bench_resident_bytes();
+        for (size_t i = 0; i < population; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_seconds(1000000.0f)));
+        size_t after = bench_resident_bytes();
+        int64_t frames_after = coroutine_pool::frame_pool::get_stats().bytes_in_use;
+
+        bench_report_memory("memory_parked", flavour, population,
+            (double)(frames_after - frames_before) / (double)population,
+            after > before ? (double)(after - before) / (double)population : 0.0);
+
+        destroy_all(*manager, coroutines);
+    }
+}
+
+void bench_await(const bench_options& options)
+{
+    size_t scale = options.quick ? 10000 : 100000;
+    size_t frames = options.quick ? 10 : 100;
+
+    // 先测内存，减少前面释放的内存被复用对进程内存增量的影响
+    bench_memory(scale);
+    bench_spawn(scale);
+    bench_resume(scale, frames);
+
+    for (size_t population = 1000; population <= options.max_population; population *= 10)
+        bench_update_idle(population, 1000);
+
+    // 轮询和扫描每帧都访问全部槽位，规模较大时减少帧数
+    for (size_t population = 1000; population <= options.max_population; population *= 10)
+    {
+        size_t scan_frames = population >= 1000000 ? 10 : 100;
+
+        bench_update_polling(population, scan_frames);
+        bench_update_scan(population, scan_frames);
+        bench_deadline_scan(population, scan_frames);
+    }
+
+    bench_fan_out(scale, 10);
+    bench_one_shot(scale, 10);
+    bench_task_chain(scale / 10, frames);
+    bench_group_join(scale / 10, frames);
+}
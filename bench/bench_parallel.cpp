@@ -0,0 +1,90 @@
+﻿#include <vector>
+#include <atomic>
+#include <thread>
+#include "bench.h"
+#include "../include/coroutine_parallel.h"
+
+using namespace coroutine_parallel;
+
+namespace
+{
+    const char* flavour = "parallel";
+
+    coroutine_t bench_loop_frame(size_t frames, std::atomic<size_t>* finished)
+    {
+        for (size_t i = 0; i < frames; i++)
+            co_await wait_for_frame();
+
+        finished->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    coroutine_t bench_empty(std::atomic<size_t>* finished)
+    {
+        finished->fetch_add(1, std::memory_order_relaxed);
+        co_return;
+    }
+
+    // 每帧创建一个立即结束的子协程，创建和结束都要获取wait_mutex
+    coroutine_t bench_spawn_children(coroutine_manager* manager, size_t children, std::atomic<size_t>* finished)
+    {
+        for (size_t i = 0; i < children; i++)
+        {
+            manager->create_coroutine(bench_empty(finished));
+            co_await wait_for_frame();
+        }
+    }
+
+    void wait_finished(const std::atomic<size_t>& finished, size_t count)
+    {
+        while (finished.load(std::memory_order_relaxed) < count)
+            std::this_thread::yield();
+    }
+
+    // count个协程各让出frames次，只经过工作线程的就绪队列，population为工作线程数
+    void bench_scale_frame(size_t workers, size_t count, size_t frames)
+    {
+        std::atomic<size_t> finished{ 0 };
+        coroutine_manager manager(1);
+
+        for (size_t i = 0; i < count; i++)
+            manager.create_coroutine(bench_loop_frame(frames, &finished));
+
+        bench_timer timer;
+        manager.start(workers);
+        wait_finished(finished, count);
+        bench_report("parallel_frame", flavour, workers, count * frames, timer.elapsed_ns());
+    }
+
+    // count个协程各创建children个立即结束的子协程，统计经过wait_mutex的创建和回收，population为工作线程数
+    void bench_scale_spawn(size_t workers, size_t count, size_t children)
+    {
+        std::atomic<size_t> finished{ 0 };
+        coroutine_manager manager(1);
+
+        for (size_t i = 0; i < count; i++)
+            manager.create_coroutine(bench_spawn_children(&manager, children, &finished));
+
+        bench_timer timer;
+        manager.start(workers);
+        wait_finished(finished, count * children);
+        bench_report("parallel_spawn", flavour, workers, count * children, timer.elapsed_ns());
+    }
+}
+
+// 工作线程数为1、2、4和硬件线程数时的吞吐
+void bench_parallel(const bench_options& options)
+{
+    size_t count = options.quick ? 1000 : 10000;
+    size_t frames = options.quick ? 10 : 100;
+
+    std::vector<size_t> worker_counts = { 1, 2, 4 };
+    size_t hardware = (size_t)std::thread::hardware_concurrency();
+    if (hardware > 4)
+        worker_counts.push_back(hardware);
+
+    for (size_t workers : worker_counts)
+    {
+        bench_scale_frame(workers, count, frames);
+        bench_scale_spawn(workers, count, frames);
+    }
+}
@@ -0,0 +1,218 @@
+﻿#include <vector>
+#include <memory>
+#include "bench.h"
+#include "../include/coroutine_yield.h"
+
+using namespace coroutine_yield;
+
+coroutine_manager* coroutine_manager::instance = nullptr;
+
+namespace
+{
+    const char* flavour = "yield";
+
+    coroutine_t bench_empty()
+    {
+        co_return;
+    }
+
+    coroutine_t bench_park_frame()
+    {
+        wait_for_frame wait;
+        co_yield &wait;
+    }
+
+    coroutine_t bench_loop_frame(const bool* stop)
+    {
+        wait_for_frame wait;
+        while (!*stop)
+            co_yield &wait;
+    }
+
+    coroutine_t bench_park_seconds(float seconds)
+    {
+        wait_for_seconds wait(seconds);
+        co_yield &wait;
+    }
+
+    coroutine_t bench_loop_event(int event_id, const bool* stop, size_t* received)
+    {
+        while (!*stop)
+        {
+            wait_for_event wait(event_id, 1000000.0f);
+            co_yield &wait;
+            if (wait.result != nullptr)
+                ++*received;
+        }
+    }
+
+    coroutine_t bench_join_group(uint64_t* coroutines, size_t count)
+    {
+        wait_for_coroutine_group wait(coroutines, count);
+        co_yield &wait;
+    }
+
+    std::unique_ptr<coroutine_manager> make_manager(uint64_t& tick)
+    {
+        tick = 1;
+        return std::make_unique<coroutine_manager>(tick);
+    }
+
+    void destroy_all(coroutine_manager& manager, const std::vector<uint64_t>& coroutines)
+    {
+        for (uint64_t id : coroutines)
+            manager.destroy_coroutine(id);
+    }
+
+    // create_coroutine到第一次挂起的开销，以及立即结束的协程
+    void bench_spawn(size_t count)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+
+        bench_timer timer;
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_frame()));
+        bench_report("spawn_parked", flavour, count, count, timer.elapsed_ns());
+
+        manager->update(++tick);
+
+        bench_timer empty_timer;
+        for (size_t i = 0; i < count; i++)
+            manager->create_coroutine(bench_empty());
+        bench_report("spawn_complete", flavour, count, count, empty_timer.elapsed_ns());
+    }
+
+    // 每帧恢复一次的协程，统计单次恢复的平均开销
+    void bench_resume(size_t count, size_t frames)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        bool stop = false;
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_loop_frame(&stop)));
+
+        bench_timer timer;
+        for (size_t i = 0; i < frames; i++)
+            manager->update(++tick);
+        bench_report("resume", flavour, count, count * frames, timer.elapsed_ns());
+
+        stop = true;
+        manager->update(++tick);
+        destroy_all(*manager, coroutines);
+    }
+
+    // 大量协程长时间挂起时，空转update的开销
+    void bench_update_idle(size_t population, size_t frames)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(population);
+        for (size_t i = 0; i < population; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_seconds(1000000.0f + (float)(i % 1000))));
+
+        bench_timer timer;
+        for (size_t i = 0; i < frames; i++)
+            manager->update(++tick);
+        bench_report("update_idle", flavour, population, frames, timer.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // count个等待者各收到rounds次事件，统计单次投递的开销
+    void bench_fan_out(size_t count, size_t rounds)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        bool stop = false;
+        size_t received = 0;
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            coroutines.push_back(manager->create_coroutine(bench_loop_event(1, &stop, &received)));
+
+        int value = 1;
+
+        bench_timer timer;
+        while (received < count * rounds)
+            manager->trigger_event(1, &value);
+        bench_report("trigger_fan_out", flavour, count, received, timer.elapsed_ns());
+
+        destroy_all(*manager, coroutines);
+    }
+
+    // count个子协程下一帧结束，父协程等待全部完成
+    void bench_group_join(size_t count, size_t rounds)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> children(count);
+
+        double total = 0.0;
+        for (size_t round = 0; round < rounds; round++)
+        {
+            bench_timer timer;
+
+            for (size_t i = 0; i < count; i++)
+                children[i] = manager->create_coroutine(bench_park_frame());
+
+            uint64_t parent = manager->create_coroutine(bench_join_group(children.data(), children.size()));
+
+            while (manager->exists_coroutine(parent))
+                manager->update(++tick);
+
+            total += timer.elapsed_ns();
+        }
+        bench_report("group_join", flavour, count, count * rounds, total);
+    }
+
+    // 每个挂起协程占用的内存
+    void bench_memory(size_t population)
+    {
+        uint64_t tick;
+        auto manager = make_manager(tick);
+
+        std::vector<uint64_t> coroutines;
+        coroutines.reserve(population);
+
+        int64_t frames_before = coroutine_pool::frame_pool::get_stats().bytes_in_use;
+        size_t before = bench_resident_bytes();
+        for (size_t i = 0; i < population; i++)
+            coroutines.push_back(manager->create_coroutine(bench_park_seconds(1000000.0f)));
+        size_t after = bench_resident_bytes();
+        int64_t frames_after = coroutine_pool::frame_pool::get_stats().bytes_in_use;
+
+        bench_report_memory("memory_parked", flavour, population,
+            (double)(frames_after - frames_before) / (double)population,
+            after > before ? (double)(after - before) / (double)population : 0.0);
+
+        destroy_all(*manager, coroutines);
+    }
+}
+
+void bench_yield(const bench_options& options)
+{
+    size_t scale = options.quick ? 10000 : 100000;
+    size_t frames = options.quick ? 10 : 100;
+
+    // 先测内存，减少前面释放的内存被复用对进程内存增量的影响
+    bench_memory(scale);
+    bench_spawn(scale);
+    bench_resume(scale, frames);
+
+    for (size_t population = 1000; population <= options.max_population; population *= 10)
+        bench_update_idle(population, 1000);
+
+    bench_fan_out(scale, 10);
+    bench_group_join(scale / 10, frames);
+}
@@ -3,6 +3,7 @@
 
 extern void test_await();
 extern void test_yield();
+extern void test_parallel();
 
 int main()
 {
@@ -14,5 +15,9 @@ int main()
 
     test_yield();
 
+    std::cout << "test parallel!\n";
+
+    test_parallel();
+
     return 0;
 }
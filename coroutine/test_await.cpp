@@ -1,4 +1,9 @@
 ﻿#include <iostream>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <algorithm>
 #include "../include/coroutine_await.h"
 
 #if defined _WIN64
@@ -7,16 +12,14 @@ inline uint64_t get_tick_count()
 {
     return GetTickCount64();
 }
-
-inline void sleep(int ms)
-{
-    Sleep(ms);
-}
 #endif
 
 #if defined __linux__
-#include <sys/time.h>
-#include <thread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <thread>
+#include <chrono>
 inline uint64_t get_tick_count()
 {
     struct timespec ts;
@@ -52,9 +55,9 @@ coroutine_t coroutine3_wait_for_event(int event_id, float seconds)
 {
     std::cout << "coroutine3_wait_for_event begin ..., event_id:" << event_id << std::endl;
 
-    const float* result = co_await wait_for_event<float>(event_id, 5.0f);
+    std::optional<float> result = co_await wait_for_event<float>(event_id, 5.0f);
 
-    if (nullptr == result)
+    if (!result)
     {
         std::cout << "coroutine3_wait_for_event end, timeout" << " event_id:" << event_id << std::endl;
     }
@@ -73,6 +76,670 @@ coroutine_t coroutine4_wait_for_coroutine_group(uint64_t* coroutines, size_t cou
     std::cout << "coroutine4_wait_for_coroutine_group end, " << std::endl;
 }
 
+coroutine_t coroutine5_wait_for_shard_frames(int shard, int frames, int* counter)
+{
+    for (int i = 0; i < frames; i++)
+    {
+        co_await wait_for_frame();
+        ++(*counter);
+    }
+
+    std::cout << "coroutine5_wait_for_shard_frames end, shard:" << shard << " frames:" << *counter << std::endl;
+}
+
+coroutine_t coroutine6_wait_for_duration(std::chrono::microseconds duration)
+{
+    std::cout << "coroutine6_wait_for_duration begin ..., " << duration.count() << "us" << std::endl;
+
+    float wait_seconds = co_await wait_for_seconds(duration);
+
+    std::cout << "coroutine6_wait_for_duration end, " << wait_seconds << std::endl;
+}
+
+coroutine_t coroutine7_wait_for_posted_events(int event_id, int count, int* sum)
+{
+    for (int i = 0; i < count; i++)
+    {
+        std::optional<int> value = co_await wait_for_event<int>(event_id, 60.0f);
+        if (value)
+            *sum += *value;
+    }
+
+    std::cout << "coroutine7_wait_for_posted_events end, sum:" << *sum << std::endl;
+}
+
+coroutine_t coroutine8_wait_for_owned_event(int event_id, int* received)
+{
+    std::optional<std::unique_ptr<int>> value = co_await wait_for_event<std::unique_ptr<int>>(event_id, 60.0f);
+    if (value && *value)
+        *received += **value;
+
+    std::cout << "coroutine8_wait_for_owned_event end, received:" << *received << std::endl;
+}
+
+// tick精度为微秒，等待时长用std::chrono指定
+void test_await_duration()
+{
+    coroutine_manager manager(0, 1000000);
+
+    uint64_t id = manager.create_coroutine(coroutine6_wait_for_duration(std::chrono::microseconds(1500)));
+
+    uint64_t tick = 0;
+    while (manager.exists_coroutine(id))
+        manager.update(tick += 100);
+
+    assert(tick == 1500);
+}
+
+// 定时等待不挂入时间轮，update时扫描槽位表的deadline列
+void test_await_scan()
+{
+    coroutine_manager manager(0, 1000000);
+    manager.set_timer_mode(timer_mode::scan);
+
+    uint64_t id = manager.create_coroutine(coroutine6_wait_for_duration(std::chrono::microseconds(2500)));
+
+    uint64_t tick = 0;
+    while (manager.exists_coroutine(id))
+        manager.update(tick += 100);
+
+    assert(tick == 2500);
+}
+
+// 其他线程用post_event投递事件，update开始时触发
+void test_await_inbox()
+{
+    coroutine_manager manager(0);
+    int sum = 0;
+
+    uint64_t id = manager.create_coroutine(coroutine7_wait_for_posted_events(2, 100, &sum));
+
+    std::thread producer([&manager]()
+    {
+        for (int i = 1; i <= 100; i++)
+        {
+            while (!manager.post_event(2, i))
+                std::this_thread::yield();
+        }
+    });
+
+    while (manager.exists_coroutine(id))
+        manager.update(1);
+
+    producer.join();
+
+    assert(sum == 5050);
+}
+
+// 只能移动的事件值每次只交给最早挂起的一个等待者
+void test_await_move_only()
+{
+    coroutine_manager manager(0);
+    int received = 0;
+
+    manager.create_coroutine(coroutine8_wait_for_owned_event(3, &received));
+    uint64_t second = manager.create_coroutine(coroutine8_wait_for_owned_event(3, &received));
+
+    manager.trigger_event(3, std::make_unique<int>(1));
+    assert(received == 1);
+
+    manager.post_event(3, std::make_unique<int>(2));
+    while (manager.exists_coroutine(second))
+        manager.update(1);
+
+    assert(received == 3);
+}
+
+task<int> task1_add_depth(int depth)
+{
+    if (depth == 0)
+        co_return 0;
+
+    int value = co_await task1_add_depth(depth - 1);
+    co_return value + 1;
+}
+
+task<float> task2_wait_then_return(float seconds)
+{
+    float waited = co_await wait_for_seconds(seconds);
+    co_return waited;
+}
+
+coroutine_t coroutine9_await_tasks(int depth, int* result)
+{
+    *result = co_await task1_add_depth(depth);
+
+    float waited = co_await task2_wait_then_return(0.01f);
+
+    std::cout << "coroutine9_await_tasks end, depth:" << *result << " waited:" << waited << std::endl;
+}
+
+coroutine_t coroutine10_wait_for_coroutine(uint64_t id, int* finished)
+{
+    co_await wait_for_coroutine(id);
+    ++(*finished);
+}
+
+coroutine_t coroutine11_record_next_frame(int tag, std::vector<int>* order)
+{
+    co_await wait_for_frame();
+    order->push_back(tag);
+}
+
+// 超出update预算的恢复留到下一次update，critical先恢复，background最后
+void test_await_budget()
+{
+    coroutine_manager manager(0);
+    std::vector<int> order;
+
+    manager.create_coroutine(coroutine11_record_next_frame(9, &order), priority::background);
+    for (int i = 1; i <= 4; i++)
+        manager.create_coroutine(coroutine11_record_next_frame(i, &order));
+    manager.create_coroutine(coroutine11_record_next_frame(0, &order), priority::critical);
+
+    manager.update(1, update_budget::resumes_at_most(3));
+    assert(order == std::vector<int>({ 0, 1, 2 }));
+
+    manager.update(2);
+    assert(order == std::vector<int>({ 0, 1, 2, 3, 4, 9 }));
+}
+
+coroutine_t coroutine12_wait_until_cancelled(int* cancelled)
+{
+    wait_for_event<int> waiter(5, 60.0f);
+    std::optional<int> value = co_await waiter;
+
+    if (!value && waiter.is_cancelled())
+        ++(*cancelled);
+}
+
+coroutine_t coroutine13_spawn_then_wait(int* cancelled)
+{
+    // 子协程继承取消标记
+    coroutine_manager::get_current()->create_coroutine(coroutine12_wait_until_cancelled(cancelled));
+
+    co_await wait_for_seconds(60.0f);
+
+    // gcc 12在if条件中使用co_await会生成错误的代码
+    bool was_cancelled = co_await check_cancelled();
+    if (was_cancelled)
+        ++(*cancelled);
+}
+
+coroutine_t coroutine14_destroy_self(const uint64_t* id, int* steps)
+{
+    co_await wait_for_frame();
+
+    // 运行中删除自己，挂起后才回收
+    coroutine_manager::get_current()->destroy_coroutine(*id);
+    ++(*steps);
+
+    co_await wait_for_frame();
+    ++(*steps);
+}
+
+// 取消时挂起的协程立即恢复，子协程一起取消
+void test_await_cancel()
+{
+    coroutine_manager manager(0);
+    int cancelled = 0;
+
+    uint64_t single = manager.create_coroutine(coroutine12_wait_until_cancelled(&cancelled));
+    manager.cancel_coroutine(single);
+    assert(cancelled == 1 && !manager.exists_coroutine(single));
+
+    cancellation_source source;
+    for (int i = 0; i < 3; i++)
+        manager.create_coroutine(coroutine13_spawn_then_wait(&cancelled), priority::normal, source.get_token());
+
+    source.cancel();
+    assert(cancelled == 7);
+
+    int steps = 0;
+    uint64_t id = 0;
+    id = manager.create_coroutine(coroutine14_destroy_self(&id, &steps));
+
+    manager.update(1);
+    assert(steps == 1 && !manager.exists_coroutine(id));
+}
+
+#if defined COROUTINE_REACTOR
+coroutine_t coroutine15_read_pipe(int fd, std::string* received, bool* closed)
+{
+    char buffer[8];
+
+    while (true)
+    {
+        ssize_t size = co_await async_read(fd, buffer, sizeof(buffer));
+        if (size <= 0)
+            break;
+
+        received->append(buffer, (size_t)size);
+    }
+
+    *closed = true;
+}
+
+// fd就绪后在下一次update中完成读取，写端关闭后读到0
+void test_await_io()
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    coroutine_manager manager(0);
+    std::string received;
+    bool closed = false;
+
+    manager.create_coroutine(coroutine15_read_pipe(fds[0], &received, &closed));
+    manager.update(1);
+
+    if (write(fds[1], "hello", 5) == 5)
+    {
+        manager.update(2);
+        assert(received == "hello");
+    }
+
+    close(fds[1]);
+    manager.update(3);
+    assert(closed);
+
+    close(fds[0]);
+}
+
+coroutine_t coroutine25_wait_readable(int fd, float seconds, int* failed)
+{
+    bool ready = co_await wait_for_readable(fd, seconds);
+    if (!ready)
+        ++(*failed);
+}
+
+// 超时、被取消或销毁的等待从reactor摘除，之后update不再轮询epoll
+void test_await_io_timeout()
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    coroutine_manager manager(0);
+    int failed = 0;
+
+    manager.create_coroutine(coroutine25_wait_readable(fds[0], 0.005f, &failed));
+    assert(!manager.io_idle());
+
+    manager.update(10);
+    assert(failed == 1 && manager.io_idle());
+
+    uint64_t id = manager.create_coroutine(coroutine25_wait_readable(fds[0], -1.0f, &failed));
+    manager.cancel_coroutine(id);
+    assert(failed == 2 && manager.io_idle());
+
+    id = manager.create_coroutine(coroutine25_wait_readable(fds[0], -1.0f, &failed));
+    manager.destroy_coroutine(id);
+    assert(failed == 2 && manager.io_idle());
+
+    close(fds[1]);
+    close(fds[0]);
+}
+#endif
+
+coroutine_t coroutine16_wait_posted(int* value)
+{
+    std::optional<int> posted = co_await wait_for_event<int>(16, 5.0f);
+    *value = posted.value_or(-1);
+}
+
+// run阻塞等待，其他线程投递事件时立即唤醒
+void test_await_run()
+{
+    coroutine_manager manager(0, 1000000);
+
+    int value = 0;
+    uint64_t id = manager.create_coroutine(coroutine16_wait_posted(&value));
+
+    std::thread producer([&manager]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        manager.post_event(16, 42);
+    });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    manager.run_until([&manager, id]() { return !manager.exists_coroutine(id); });
+    producer.join();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "test_await_run woken after " << elapsed.count() << "ms" << std::endl;
+
+    assert(value == 42 && manager.get_next_wakeup() == coroutine_manager::no_wakeup);
+}
+
+coroutine_t coroutine17_lock_mutex(async_mutex* mutex, int tag, std::vector<int>* order)
+{
+    bool locked = co_await mutex->lock();
+    if (locked)
+    {
+        // 持有锁跨过一帧，其他协程挂起等待，不参与轮询
+        order->push_back(tag);
+        co_await wait_for_frame();
+        mutex->unlock();
+    }
+}
+
+coroutine_t coroutine18_acquire_semaphore(async_semaphore* semaphore, int* active, int* peak)
+{
+    bool acquired = co_await semaphore->acquire();
+    if (acquired)
+    {
+        *peak = std::max(*peak, ++(*active));
+        co_await wait_for_frame();
+        --(*active);
+        semaphore->release();
+    }
+}
+
+coroutine_t coroutine19_barrier_rounds(async_barrier* barrier, async_latch* latch, int rounds, int* passed)
+{
+    for (int i = 0; i < rounds; i++)
+    {
+        bool completed = co_await barrier->arrive_and_wait();
+        if (completed)
+            ++(*passed);
+    }
+
+    latch->count_down();
+}
+
+coroutine_t coroutine20_wait_latch(async_latch* latch, bool* released)
+{
+    *released = co_await latch->wait();
+}
+
+// 释放时按挂起顺序直接交给等待者，取消的等待者不会得到锁
+void test_await_sync()
+{
+    coroutine_manager manager(0);
+
+    async_mutex mutex;
+    std::vector<int> order;
+    for (int i = 0; i < 3; i++)
+        manager.create_coroutine(coroutine17_lock_mutex(&mutex, i, &order));
+
+    for (uint64_t tick = 1; tick <= 6; tick++)
+        manager.update(tick);
+    assert(order == std::vector<int>({ 0, 1, 2 }) && !mutex.is_locked());
+
+    mutex.try_lock();
+    manager.cancel_coroutine(manager.create_coroutine(coroutine17_lock_mutex(&mutex, 9, &order)));
+    mutex.unlock();
+    assert(order.size() == 3 && !mutex.is_locked());
+
+    async_semaphore semaphore(2);
+    int active = 0;
+    int peak = 0;
+    for (int i = 0; i < 5; i++)
+        manager.create_coroutine(coroutine18_acquire_semaphore(&semaphore, &active, &peak));
+
+    for (uint64_t tick = 7; tick <= 12; tick++)
+        manager.update(tick);
+    assert(peak == 2 && active == 0 && semaphore.available() == 2);
+
+    async_barrier barrier(3);
+    async_latch latch(3);
+    int passed = 0;
+    bool released = false;
+
+    manager.create_coroutine(coroutine20_wait_latch(&latch, &released));
+    for (int i = 0; i < 3; i++)
+        manager.create_coroutine(coroutine19_barrier_rounds(&barrier, &latch, 4, &passed));
+
+    for (uint64_t tick = 13; tick <= 20; tick++)
+        manager.update(tick);
+    assert(passed == 12 && barrier.get_phase() == 4 && released);
+
+    // 退出的参与者不再计入，最后一个参与者退出时不完成空的阶段
+    async_barrier shrinking(2);
+    async_latch never(1);
+    passed = 0;
+
+    manager.create_coroutine(coroutine19_barrier_rounds(&shrinking, &never, 1, &passed));
+    shrinking.arrive_and_drop();
+    manager.update(21);
+    assert(passed == 1 && shrinking.get_phase() == 1);
+
+    shrinking.arrive_and_drop();
+    assert(shrinking.get_phase() == 1);
+
+    // 多减的计数不回绕
+    async_latch clamped(2);
+    clamped.count_down(5);
+    clamped.count_down();
+    assert(clamped.try_wait());
+}
+
+coroutine_t coroutine21_send_numbers(channel<std::unique_ptr<int>>* numbers, int count)
+{
+    for (int i = 1; i <= count; i++)
+    {
+        bool sent = co_await numbers->send(std::make_unique<int>(i));
+        if (!sent)
+            break;
+    }
+
+    numbers->close();
+}
+
+coroutine_t coroutine22_receive_numbers(channel<std::unique_ptr<int>>* numbers, int* sum, int* batches)
+{
+    std::vector<std::unique_ptr<int>> batch;
+
+    while (true)
+    {
+        batch.clear();
+
+        size_t count = co_await numbers->receive_many(batch, 4);
+        if (count == 0)
+            break;
+
+        ++(*batches);
+        for (size_t i = 0; i < count; i++)
+            *sum += *batch[i];
+
+        // 处理慢于发送，发送者在缓冲满时挂起
+        co_await wait_for_frame();
+    }
+}
+
+coroutine_t coroutine26_receive_one(channel<int>* numbers, int* received)
+{
+    std::optional<int> value = co_await numbers->receive();
+    *received = value ? *value : -1;
+}
+
+// 缓冲满时发送者挂起，接收者每次批量取走缓冲中的值，关闭后取完剩余的值再结束
+void test_await_channel()
+{
+    coroutine_manager manager(0);
+
+    channel<std::unique_ptr<int>> numbers(4);
+    int sum = 0;
+    int batches = 0;
+
+    manager.create_coroutine(coroutine22_receive_numbers(&numbers, &sum, &batches));
+    manager.create_coroutine(coroutine21_send_numbers(&numbers, 10));
+
+    uint64_t tick = 1;
+    while (sum < 55 && tick < 20)
+        manager.update(tick++);
+
+    assert(sum == 55 && batches <= 4 && numbers.is_closed() && numbers.size() == 0);
+
+    channel<int> single(1);
+    assert(single.try_send(1) && !single.try_send(2) && single.try_receive() == 1);
+
+    // 容量为0时先到的发送者挂起，之后开始接收的协程直接从它取值
+    channel<std::unique_ptr<int>> unbuffered(0);
+    std::unique_ptr<int> extra = std::make_unique<int>(0);
+    assert(!unbuffered.try_send(std::move(extra)) && extra != nullptr);
+
+    sum = 0;
+    batches = 0;
+    manager.create_coroutine(coroutine21_send_numbers(&unbuffered, 3));
+    manager.create_coroutine(coroutine22_receive_numbers(&unbuffered, &sum, &batches));
+
+    while (!unbuffered.is_closed() && tick < 40)
+        manager.update(tick++);
+
+    assert(sum == 6 && unbuffered.is_closed());
+
+    // 交给接收者的值在其恢复前被销毁时转给下一个接收者
+    channel<int> handoff(1);
+    int first = 0;
+    int second = 0;
+    uint64_t first_id = manager.create_coroutine(coroutine26_receive_one(&handoff, &first));
+    manager.create_coroutine(coroutine26_receive_one(&handoff, &second));
+
+    assert(handoff.try_send(7));
+    manager.destroy_coroutine(first_id);
+    manager.update(tick++);
+    assert(first == 0 && second == 7 && handoff.size() == 0);
+
+    // 没有其他接收者时放回缓冲头部，缓冲已满也不丢失
+    first_id = manager.create_coroutine(coroutine26_receive_one(&handoff, &first));
+    assert(handoff.try_send(8) && handoff.try_send(9) && !handoff.try_send(10));
+    manager.destroy_coroutine(first_id);
+    assert(first == 0 && handoff.size() == 2);
+    assert(handoff.try_receive() == 8 && handoff.try_receive() == 9 && handoff.size() == 0);
+}
+
+coroutine_t coroutine23_frames_then_sleep(int frames)
+{
+    for (int i = 0; i < frames; i++)
+        co_await wait_for_frame();
+
+    co_await wait_for_seconds(std::chrono::milliseconds(5));
+}
+
+coroutine_t coroutine24_finish_at_once()
+{
+    co_return;
+}
+
+// 定义COROUTINE_METRICS时按协程记录恢复次数和每种等待的挂起tick，否则只有槽位数量
+void test_await_metrics()
+{
+    coroutine_manager manager(0);
+
+    uint64_t id = manager.create_coroutine(coroutine23_frames_then_sleep(3));
+    manager.create_coroutine(coroutine24_finish_at_once());
+
+    for (uint64_t tick = 1; tick <= 5; tick++)
+        manager.update(tick);
+
+    manager_stats stats = manager.get_stats();
+    std::cout << "test_await_metrics live:" << stats.live_coroutines << " free:" << stats.free_slots << " update_resumes:" << stats.resumes_per_update() << std::endl;
+    assert(stats.live_coroutines == 1 && stats.free_slots == 1);
+
+    coroutine_stats detail;
+#if defined COROUTINE_METRICS
+    assert(stats.enabled && stats.spawns == 2 && stats.resumes == 3 && stats.updates == 5);
+
+    // 每次等待一帧在就绪队列中1个tick，tick 3开始定时等待
+    if (manager.get_coroutine_stats(id, detail))
+        assert(detail.resumes == 3 && detail.suspended_ticks[(size_t)coroutine_slot::wait_kind::ready] == 3 &&
+            detail.suspended_ticks[(size_t)coroutine_slot::wait_kind::timer] == 2);
+#else
+    assert(!stats.enabled && !manager.get_coroutine_stats(id, detail));
+#endif
+
+    manager.destroy_coroutine(id);
+}
+
+// 依赖链在一次update内完成，超出预算的留到下一次update
+void test_await_cascade()
+{
+    coroutine_manager manager(0);
+    manager.set_resume_mode(resume_mode::cascade, 5);
+
+    int finished = 0;
+    uint64_t id = manager.create_coroutine(coroutine2_wait_for_frame());
+    for (int i = 0; i < 8; i++)
+        id = manager.create_coroutine(coroutine10_wait_for_coroutine(id, &finished));
+
+    manager.update(1);
+    assert(finished == 5);
+
+    manager.update(2);
+    assert(finished == 8 && !manager.exists_coroutine(id));
+}
+
+// 嵌套的task在创建协程时同步完成，task中的等待由顶层协程的槽位挂起
+void test_await_task()
+{
+    coroutine_manager manager(0);
+    int result = 0;
+
+    uint64_t id = manager.create_coroutine(coroutine9_await_tasks(100, &result));
+    assert(result == 100);
+
+    uint64_t tick = 0;
+    while (manager.exists_coroutine(id))
+        manager.update(++tick);
+
+    assert(tick == 10);
+}
+
+// 一次性、前N个和广播三种分发方式，批量触发时值按挂起顺序依次交给等待者
+void test_await_delivery()
+{
+    coroutine_manager manager(0);
+    int sum = 0;
+
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 6; i++)
+        ids.emplace_back(manager.create_coroutine(coroutine7_wait_for_posted_events(4, 1, &sum)));
+
+    manager.trigger_event(4, 1, delivery::one_shot());
+    manager.trigger_event(4, 10, delivery::first(2));
+    assert(sum == 21);
+
+    int values[2] = { 100, 1000 };
+    manager.trigger_events(4, values, 2);
+    assert(sum == 1121);
+
+    manager.trigger_event(4, 10000, delivery::broadcast());
+    assert(sum == 11121);
+
+    for (size_t i = 0; i < ids.size(); i++)
+        assert(!manager.exists_coroutine(ids[i]));
+}
+
+// 每个线程一个独立的管理器，不使用coroutine_manager::instance
+void test_await_shards()
+{
+    std::vector<std::thread> shards;
+
+    for (int shard = 0; shard < 2; shard++)
+    {
+        shards.emplace_back([shard]()
+        {
+            coroutine_manager manager(0);
+            int counter = 0;
+
+            uint64_t id = manager.create_coroutine(coroutine5_wait_for_shard_frames(shard, 100, &counter));
+
+            for (uint64_t tick = 1; manager.exists_coroutine(id); tick++)
+                manager.update(tick);
+        });
+    }
+
+    for (size_t i = 0; i < shards.size(); i++)
+        shards[i].join();
+}
+
 void test_await()
 {
     coroutine_manager coroutine_manager(get_tick_count());
@@ -89,12 +756,27 @@ void test_await()
     float result = 10.0f;
     coroutine_manager::instance->trigger_event(1, &result);
 
-    while (true)
-    {
-        coroutine_manager::instance->update(get_tick_count());
-        if (!coroutine_manager::instance->exists_coroutine(wait_id))
-            break;
+    // 空闲时睡到下一个deadline，不再固定sleep轮询
+    coroutine_manager::instance->run_until([wait_id]() { return !coroutine_manager::instance->exists_coroutine(wait_id); });
 
-        sleep(10);
-    }
+    coroutine_manager::instance = nullptr;
+
+    test_await_shards();
+    test_await_duration();
+    test_await_scan();
+    test_await_inbox();
+    test_await_move_only();
+    test_await_delivery();
+    test_await_task();
+    test_await_cascade();
+    test_await_budget();
+    test_await_cancel();
+    test_await_run();
+    test_await_sync();
+    test_await_channel();
+    test_await_metrics();
+#if defined COROUTINE_REACTOR
+    test_await_io();
+    test_await_io_timeout();
+#endif
 }
@@ -0,0 +1,131 @@
+﻿#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <assert.h>
+#include "../include/coroutine_parallel.h"
+
+using namespace coroutine_parallel;
+
+static std::atomic<int> finished_count{ 0 };
+
+inline uint64_t get_parallel_tick()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+coroutine_t coroutine1_parallel_work(int loops)
+{
+    uint64_t sum = 0;
+
+    for (int i = 0; i < loops; i++)
+    {
+        for (int j = 0; j < 1000; j++)
+            sum += (uint64_t)i * j;
+
+        co_await wait_for_frame();
+    }
+
+    if (sum != (uint64_t)-1)
+        ++finished_count;
+}
+
+coroutine_t coroutine2_parallel_wait_for_event(int event_id, std::atomic<float>* received)
+{
+    std::optional<float> result = co_await wait_for_event<float>(event_id, 5.0f);
+
+    if (result)
+    {
+        std::cout << "coroutine2_parallel_wait_for_event end, " << *result << " event_id:" << event_id << std::endl;
+        received->store(*result);
+    }
+    else
+    {
+        std::cout << "coroutine2_parallel_wait_for_event end, timeout" << " event_id:" << event_id << std::endl;
+    }
+}
+
+// 被等待的协程结束后才恢复，此时它收到的值已写入
+coroutine_t coroutine3_parallel_wait_for_coroutine(uint64_t id, const std::atomic<float>* received, std::atomic<float>* joined)
+{
+    co_await wait_for_coroutine(id);
+
+    std::cout << "coroutine3_parallel_wait_for_coroutine end" << std::endl;
+    joined->store(received->load());
+}
+
+// 每帧检查一次标记，abort用于测试失败时退出
+coroutine_t coroutine4_parallel_poll_flag(const std::atomic<bool>* flag, const std::atomic<bool>* abort, std::atomic<bool>* seen)
+{
+    while (!flag->load() && !abort->load())
+        co_await wait_for_frame();
+
+    seen->store(flag->load());
+}
+
+coroutine_t coroutine5_parallel_set_flag(std::atomic<bool>* flag)
+{
+    flag->store(true);
+    co_return;
+}
+
+void test_parallel_fairness()
+{
+    coroutine_manager manager(get_parallel_tick());
+    manager.start(1);
+
+    std::atomic<bool> flag{ false };
+    std::atomic<bool> abort{ false };
+    std::atomic<bool> seen{ false };
+
+    uint64_t poller = manager.create_coroutine(coroutine4_parallel_poll_flag(&flag, &abort, &seen));
+
+    // 轮询的协程已在唯一的工作线程上反复让出，之后创建的协程也要能轮到
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    manager.create_coroutine(coroutine5_parallel_set_flag(&flag));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (manager.exists_coroutine(poller) && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    abort.store(true);
+    while (manager.exists_coroutine(poller))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::cout << "test_parallel_fairness seen: " << seen.load() << std::endl;
+    assert(seen.load());
+}
+
+void test_parallel()
+{
+    coroutine_manager manager(get_parallel_tick());
+    manager.start(4);
+
+    const int count = 1000;
+    for (int i = 0; i < count; i++)
+        manager.create_coroutine(coroutine1_parallel_work(100));
+
+    std::atomic<float> received{ 0.0f };
+    std::atomic<float> joined{ 0.0f };
+
+    uint64_t event_id = manager.create_coroutine(coroutine2_parallel_wait_for_event(1, &received));
+    uint64_t wait_id = manager.create_coroutine(coroutine3_parallel_wait_for_coroutine(event_id, &received, &joined));
+
+    // 等待事件协程挂起后再触发
+    while (true)
+    {
+        manager.trigger_event(1, 10.0f);
+        manager.update(get_parallel_tick());
+
+        if (!manager.exists_coroutine(wait_id) && finished_count == count)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::cout << "test_parallel finished: " << finished_count << ", steals: " << manager.get_steal_count() << std::endl;
+    assert(finished_count == count);
+    assert(received.load() == 10.0f && joined.load() == 10.0f);
+    assert(!manager.exists_coroutine(event_id));
+
+    test_parallel_fairness();
+}
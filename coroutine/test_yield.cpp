@@ -1,4 +1,8 @@
 ﻿#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <memory>
+#include <string>
 #include "../include/coroutine_yield.h"
 
 #if defined _WIN64
@@ -7,16 +11,14 @@ inline uint64_t get_tick_count()
 {
     return GetTickCount64();
 }
-
-inline void sleep(int ms)
-{
-    Sleep(ms);
-}
 #endif
 
 #if defined __linux__
-#include <sys/time.h>
-#include <thread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <thread>
+#include <chrono>
 inline uint64_t get_tick_count()
 {
     struct timespec ts;
@@ -80,6 +82,642 @@ coroutine_t coroutine4_yield_for_coroutine_group(uint64_t* coroutines, size_t co
     std::cout << "coroutine4_yield_for_coroutine_group end, " << std::endl;
 }
 
+generator<int> squares(int count)
+{
+    for (int i = 0; i < count; i++)
+        co_yield i * i;
+}
+
+// 每产出一个值前等待一帧，取值的协程每次只持有一个值
+async_generator<int> frames_counter(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        wait_for_frame _wait;
+        co_yield &_wait;
+
+        co_yield i;
+    }
+}
+
+coroutine_t coroutine5_yield_for_generator(int count, int* sum)
+{
+    std::cout << "coroutine5_yield_for_generator begin ..., " << std::endl;
+
+    async_generator<int> numbers = frames_counter(count);
+
+    while (true)
+    {
+        bool more = co_yield numbers.next();
+        if (!more)
+            break;
+
+        *sum += numbers.value();
+    }
+
+    std::cout << "coroutine5_yield_for_generator end, sum:" << *sum << std::endl;
+}
+
+// 产出count个值后抛出异常
+async_generator<int> frames_then_throw(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        wait_for_frame _wait;
+        co_yield &_wait;
+
+        co_yield i;
+    }
+
+    throw std::runtime_error("producer failed");
+}
+
+// 生成器的异常在取值的协程中重新抛出
+coroutine_t coroutine9_yield_for_throwing_generator(int* sum, bool* caught)
+{
+    async_generator<int> numbers = frames_then_throw(3);
+
+    try
+    {
+        while (true)
+        {
+            bool more = co_yield numbers.next();
+            if (!more)
+                break;
+
+            *sum += numbers.value();
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+        *caught = true;
+    }
+}
+
+struct destroy_flag
+{
+    bool* destroyed;
+
+    ~destroy_flag()
+    {
+        *destroyed = true;
+    }
+};
+
+// 在生成器内长时间等待，用于在等待中销毁取值的协程
+async_generator<int> sleep_then_count(bool* destroyed)
+{
+    destroy_flag flag{ destroyed };
+
+    wait_for_seconds _wait(1000.0f);
+    co_yield &_wait;
+
+    co_yield 1;
+}
+
+coroutine_t coroutine10_yield_for_sleeping_generator(bool* destroyed, int* received)
+{
+    async_generator<int> numbers = sleep_then_count(destroyed);
+
+    bool more = co_yield numbers.next();
+    if (more)
+        *received = numbers.value();
+}
+
+void test_yield_generator()
+{
+    int total = 0;
+    for (int value : squares(4))
+        total += value;
+
+    std::cout << "test_yield_generator squares:" << total << std::endl;
+    assert(total == 14);
+
+    coroutine_manager coroutine_manager(get_tick_count());
+
+    int sum = 0;
+    uint64_t id = coroutine_manager.create_coroutine(coroutine5_yield_for_generator(5, &sum));
+
+    coroutine_manager.run_until([&coroutine_manager, id]() { return !coroutine_manager.exists_coroutine(id); });
+
+    std::cout << "test_yield_generator sum:" << sum << std::endl;
+    assert(sum == 10);
+
+    // 生成器抛出的异常由取值的协程捕获，之前产出的值都已取到
+    sum = 0;
+    bool caught = false;
+    id = coroutine_manager.create_coroutine(coroutine9_yield_for_throwing_generator(&sum, &caught));
+
+    coroutine_manager.run_until([&coroutine_manager, id]() { return !coroutine_manager.exists_coroutine(id); });
+    assert(caught && sum == 3);
+
+    // 取值的协程在生成器等待时被销毁，生成器帧随之销毁，等待从时间轮中摘除
+    bool destroyed = false;
+    int received = 0;
+    id = coroutine_manager.create_coroutine(coroutine10_yield_for_sleeping_generator(&destroyed, &received));
+    coroutine_manager.update(get_tick_count());
+    assert(coroutine_manager.exists_coroutine(id) && !destroyed);
+
+    assert(coroutine_manager.destroy_coroutine(id));
+    assert(destroyed && !coroutine_manager.exists_coroutine(id));
+
+    coroutine_manager.update(get_tick_count() + 2000000);
+    assert(received == 0);
+}
+
+coroutine_t coroutine6_yield_for_send(channel<int>* numbers, int count)
+{
+    for (int i = 1; i <= count; i++)
+    {
+        // 缓冲满时等待接收者取走
+        channel_send<int> _send(*numbers, i);
+        co_yield &_send;
+
+        if (!_send.is_sent())
+            break;
+    }
+
+    numbers->close();
+}
+
+coroutine_t coroutine7_yield_for_receive_many(channel<int>* numbers, int* sum)
+{
+    std::vector<int> batch;
+
+    while (true)
+    {
+        batch.clear();
+
+        channel_receive_many<int> _receive(*numbers, batch, 4);
+        co_yield &_receive;
+
+        if (_receive.get_count() == 0)
+            break;
+
+        for (int value : batch)
+            *sum += value;
+    }
+
+    std::cout << "coroutine7_yield_for_receive_many end, sum:" << *sum << std::endl;
+}
+
+coroutine_t coroutine8_yield_for_receive(channel<int>* numbers, int* received)
+{
+    channel_receive<int> _receive(*numbers);
+    co_yield &_receive;
+
+    *received = _receive.get() != nullptr ? *_receive.get() : -1;
+}
+
+void test_yield_channel()
+{
+    coroutine_manager coroutine_manager(get_tick_count());
+
+    channel<int> numbers(2);
+    int sum = 0;
+
+    uint64_t id = coroutine_manager.create_coroutine(coroutine7_yield_for_receive_many(&numbers, &sum));
+    coroutine_manager.create_coroutine(coroutine6_yield_for_send(&numbers, 10));
+
+    coroutine_manager.run_until([&coroutine_manager, id]() { return !coroutine_manager.exists_coroutine(id); });
+
+    std::cout << "test_yield_channel sum:" << sum << std::endl;
+    assert(sum == 55);
+
+    // 容量为0时发送者先挂起，由之后的接收者直接取值
+    channel<int> unbuffered(0);
+    int unbuffered_sum = 0;
+
+    coroutine_manager.create_coroutine(coroutine6_yield_for_send(&unbuffered, 10));
+    id = coroutine_manager.create_coroutine(coroutine7_yield_for_receive_many(&unbuffered, &unbuffered_sum));
+
+    coroutine_manager.run_until([&coroutine_manager, id]() { return !coroutine_manager.exists_coroutine(id); });
+
+    assert(unbuffered_sum == 55 && unbuffered.is_closed());
+
+    // 交给接收者的值在其恢复前被销毁时转给下一个接收者
+    channel<int> handoff(1);
+    int first = 0;
+    int second = 0;
+    uint64_t first_id = coroutine_manager.create_coroutine(coroutine8_yield_for_receive(&handoff, &first));
+    coroutine_manager.create_coroutine(coroutine8_yield_for_receive(&handoff, &second));
+
+    assert(handoff.try_send(7));
+    coroutine_manager.destroy_coroutine(first_id);
+    coroutine_manager.update(get_tick_count());
+    assert(first == 0 && second == 7 && handoff.size() == 0);
+
+    // 没有其他接收者时放回缓冲头部，缓冲已满也不丢失
+    first_id = coroutine_manager.create_coroutine(coroutine8_yield_for_receive(&handoff, &first));
+    assert(handoff.try_send(8) && handoff.try_send(9) && !handoff.try_send(10));
+    coroutine_manager.destroy_coroutine(first_id);
+    assert(first == 0 && handoff.size() == 2);
+    assert(handoff.try_receive() == 8 && handoff.try_receive() == 9 && handoff.size() == 0);
+}
+
+coroutine_t coroutine11_yield_for_duration(std::chrono::microseconds duration)
+{
+    wait_for_seconds _wait(duration);
+    co_yield &_wait;
+}
+
+// 定时等待不挂入时间轮，update时扫描槽位表的deadline列
+void test_yield_scan()
+{
+    coroutine_manager manager(0, 1000000);
+    manager.set_timer_mode(timer_mode::scan);
+
+    uint64_t id = manager.create_coroutine(coroutine11_yield_for_duration(std::chrono::microseconds(2500)));
+
+    uint64_t tick = 0;
+    while (manager.exists_coroutine(id))
+        manager.update(tick += 100);
+
+    assert(tick == 2500);
+}
+
+coroutine_t coroutine12_yield_for_posted_events(int event_id, int count, int* sum)
+{
+    for (int i = 0; i < count; i++)
+    {
+        wait_for_event _wait(event_id, 60.0f);
+        co_yield &_wait;
+
+        int* value = _wait.get<int>();
+        if (value != nullptr)
+            *sum += *value;
+    }
+}
+
+// 其他线程用post_event投递事件，update开始时触发
+void test_yield_inbox()
+{
+    coroutine_manager manager(0);
+    int sum = 0;
+
+    uint64_t id = manager.create_coroutine(coroutine12_yield_for_posted_events(2, 100, &sum));
+
+    std::thread producer([&manager]()
+    {
+        for (int i = 1; i <= 100; i++)
+        {
+            while (!manager.post_event(2, i))
+                std::this_thread::yield();
+        }
+    });
+
+    while (manager.exists_coroutine(id))
+        manager.update(1);
+
+    producer.join();
+
+    assert(sum == 5050);
+}
+
+coroutine_t coroutine13_yield_for_owned_event(int event_id, int* received)
+{
+    wait_for_event _wait(event_id, 60.0f);
+    co_yield &_wait;
+
+    std::unique_ptr<int>* value = _wait.get<std::unique_ptr<int>>();
+    if (value != nullptr && *value)
+        *received += **value;
+}
+
+// 只能移动的事件值每次只交给最早挂起的一个等待者，类型不符时取不到
+void test_yield_move_only()
+{
+    coroutine_manager manager(0);
+    int received = 0;
+
+    uint64_t first = manager.create_coroutine(coroutine13_yield_for_owned_event(3, &received));
+    uint64_t second = manager.create_coroutine(coroutine13_yield_for_owned_event(3, &received));
+
+    manager.trigger_event(3, std::make_unique<int>(1));
+    while (manager.exists_coroutine(first))
+        manager.update(1);
+
+    assert(received == 1 && manager.exists_coroutine(second));
+
+    manager.post_event(3, std::make_unique<int>(2));
+    while (manager.exists_coroutine(second))
+        manager.update(1);
+
+    assert(received == 3);
+
+    uint64_t mismatched = manager.create_coroutine(coroutine13_yield_for_owned_event(3, &received));
+    manager.trigger_event(3, 4);
+    manager.update(2);
+    assert(received == 3 && !manager.exists_coroutine(mismatched));
+}
+
+// 一次性、前N个和广播三种分发方式，批量触发时值按挂起顺序依次交给等待者
+void test_yield_delivery()
+{
+    coroutine_manager manager(0);
+    int sum = 0;
+
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 6; i++)
+        ids.emplace_back(manager.create_coroutine(coroutine12_yield_for_posted_events(4, 1, &sum)));
+
+    manager.trigger_event(4, 1, delivery::one_shot());
+    manager.trigger_event(4, 10, delivery::first(2));
+    manager.update(1);
+    assert(sum == 21);
+
+    int values[2] = { 100, 1000 };
+    manager.trigger_events(4, values, 2);
+    manager.update(2);
+    assert(sum == 1121);
+
+    manager.trigger_event(4, 10000, delivery::broadcast());
+    manager.update(3);
+    assert(sum == 11121);
+
+    for (size_t i = 0; i < ids.size(); i++)
+        assert(!manager.exists_coroutine(ids[i]));
+}
+
+coroutine_t coroutine14_yield_for_coroutine(uint64_t id, int* finished)
+{
+    wait_for_coroutine _wait(id);
+    co_yield &_wait;
+
+    ++(*finished);
+}
+
+// 依赖链在一次update内完成，超出预算的留到下一次update
+void test_yield_cascade()
+{
+    coroutine_manager manager(0);
+    manager.set_resume_mode(resume_mode::cascade, 5);
+
+    int finished = 0;
+    uint64_t id = manager.create_coroutine(coroutine2_yield_for_frame());
+    for (int i = 0; i < 8; i++)
+        id = manager.create_coroutine(coroutine14_yield_for_coroutine(id, &finished));
+
+    manager.update(1);
+    assert(finished == 5);
+
+    manager.update(2);
+    assert(finished == 8 && !manager.exists_coroutine(id));
+}
+
+coroutine_t coroutine15_record_next_frame(int tag, std::vector<int>* order)
+{
+    wait_for_frame _wait;
+    co_yield &_wait;
+
+    order->push_back(tag);
+}
+
+// 超出update预算的恢复留到下一次update，critical先恢复，background最后
+void test_yield_budget()
+{
+    coroutine_manager manager(0);
+    std::vector<int> order;
+
+    manager.create_coroutine(coroutine15_record_next_frame(9, &order), priority::background);
+    for (int i = 1; i <= 4; i++)
+        manager.create_coroutine(coroutine15_record_next_frame(i, &order));
+    manager.create_coroutine(coroutine15_record_next_frame(0, &order), priority::critical);
+
+    manager.update(1, update_budget::resumes_at_most(3));
+    assert(order == std::vector<int>({ 0, 1, 2 }));
+
+    manager.update(2);
+    assert(order == std::vector<int>({ 0, 1, 2, 3, 4, 9 }));
+}
+
+coroutine_t coroutine16_yield_until_cancelled(int* cancelled)
+{
+    wait_for_event _wait(5, 60.0f);
+    co_yield &_wait;
+
+    if (_wait.result == nullptr && _wait.is_cancelled())
+        ++(*cancelled);
+}
+
+coroutine_t coroutine17_spawn_then_wait(int* cancelled)
+{
+    // 子协程继承取消标记
+    coroutine_manager* manager = coroutine_manager::get_current();
+    manager->create_coroutine(coroutine16_yield_until_cancelled(cancelled));
+
+    wait_for_seconds _wait(60.0f);
+    co_yield &_wait;
+
+    if (manager->is_cancelled(manager->get_running_coroutine()))
+        ++(*cancelled);
+}
+
+coroutine_t coroutine18_destroy_self(const uint64_t* id, int* steps)
+{
+    wait_for_frame _wait;
+    co_yield &_wait;
+
+    // 运行中删除自己，挂起后才回收
+    coroutine_manager::get_current()->destroy_coroutine(*id);
+    ++(*steps);
+
+    co_yield &_wait;
+    ++(*steps);
+}
+
+// 取消时挂起的协程立即恢复，子协程一起取消
+void test_yield_cancel()
+{
+    coroutine_manager manager(0);
+    int cancelled = 0;
+
+    uint64_t single = manager.create_coroutine(coroutine16_yield_until_cancelled(&cancelled));
+    manager.cancel_coroutine(single);
+    assert(cancelled == 1 && !manager.exists_coroutine(single));
+
+    cancellation_source source;
+    for (int i = 0; i < 3; i++)
+        manager.create_coroutine(coroutine17_spawn_then_wait(&cancelled), priority::normal, source.get_token());
+
+    source.cancel();
+    assert(cancelled == 7);
+
+    int steps = 0;
+    uint64_t id = 0;
+    id = manager.create_coroutine(coroutine18_destroy_self(&id, &steps));
+
+    manager.update(1);
+    assert(steps == 1 && !manager.exists_coroutine(id));
+}
+
+#if defined COROUTINE_REACTOR
+coroutine_t coroutine19_read_pipe(int fd, std::string* received, bool* closed)
+{
+    char buffer[8];
+
+    while (true)
+    {
+        async_read _read(fd, buffer, sizeof(buffer));
+        co_yield &_read;
+
+        ssize_t size = _read.get_result();
+        if (size <= 0)
+            break;
+
+        received->append(buffer, (size_t)size);
+    }
+
+    *closed = true;
+}
+
+// fd就绪后在下一次update中完成读取，写端关闭后读到0
+void test_yield_io()
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    coroutine_manager manager(0);
+    std::string received;
+    bool closed = false;
+
+    manager.create_coroutine(coroutine19_read_pipe(fds[0], &received, &closed));
+    manager.update(1);
+
+    if (write(fds[1], "hello", 5) == 5)
+    {
+        manager.update(2);
+        assert(received == "hello");
+    }
+
+    close(fds[1]);
+    manager.update(3);
+    assert(closed);
+
+    close(fds[0]);
+}
+
+coroutine_t coroutine20_yield_for_readable(int fd, float seconds, int* failed)
+{
+    wait_for_readable _wait(fd, seconds);
+    co_yield &_wait;
+
+    if (!_wait.is_ready())
+        ++(*failed);
+}
+
+// 超时、被取消或销毁的等待从reactor摘除，之后update不再轮询epoll
+void test_yield_io_timeout()
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    coroutine_manager manager(0);
+    int failed = 0;
+
+    manager.create_coroutine(coroutine20_yield_for_readable(fds[0], 0.005f, &failed));
+    assert(!manager.io_idle());
+
+    manager.update(10);
+    assert(failed == 1 && manager.io_idle());
+
+    uint64_t id = manager.create_coroutine(coroutine20_yield_for_readable(fds[0], -1.0f, &failed));
+    manager.cancel_coroutine(id);
+    assert(failed == 2 && manager.io_idle());
+
+    id = manager.create_coroutine(coroutine20_yield_for_readable(fds[0], -1.0f, &failed));
+    manager.destroy_coroutine(id);
+    assert(failed == 2 && manager.io_idle());
+
+    close(fds[1]);
+    close(fds[0]);
+}
+#endif
+
+coroutine_t coroutine21_yield_for_posted(int* value)
+{
+    wait_for_event _wait(16, 5.0f);
+    co_yield &_wait;
+
+    int* posted = _wait.get<int>();
+    *value = posted != nullptr ? *posted : -1;
+}
+
+// run阻塞等待，其他线程投递事件时立即唤醒
+void test_yield_run()
+{
+    coroutine_manager manager(0, 1000000);
+
+    int value = 0;
+    uint64_t id = manager.create_coroutine(coroutine21_yield_for_posted(&value));
+
+    std::thread producer([&manager]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        manager.post_event(16, 42);
+    });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    manager.run_until([&manager, id]() { return !manager.exists_coroutine(id); });
+    producer.join();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "test_yield_run woken after " << elapsed.count() << "ms" << std::endl;
+
+    assert(value == 42 && manager.get_next_wakeup() == coroutine_manager::no_wakeup);
+}
+
+coroutine_t coroutine22_frames_then_sleep(int frames)
+{
+    wait_for_frame _frame;
+    for (int i = 0; i < frames; i++)
+        co_yield &_frame;
+
+    wait_for_seconds _wait(std::chrono::milliseconds(5));
+    co_yield &_wait;
+}
+
+coroutine_t coroutine23_finish_at_once()
+{
+    co_return;
+}
+
+// 定义COROUTINE_METRICS时按协程记录恢复次数和每种等待的挂起tick，否则只有槽位数量
+void test_yield_metrics()
+{
+    coroutine_manager manager(0);
+
+    uint64_t id = manager.create_coroutine(coroutine22_frames_then_sleep(3));
+    manager.create_coroutine(coroutine23_finish_at_once());
+
+    for (uint64_t tick = 1; tick <= 5; tick++)
+        manager.update(tick);
+
+    manager_stats stats = manager.get_stats();
+    std::cout << "test_yield_metrics live:" << stats.live_coroutines << " free:" << stats.free_slots << " update_resumes:" << stats.resumes_per_update() << std::endl;
+    assert(stats.live_coroutines == 1 && stats.free_slots == 1);
+
+    coroutine_stats detail;
+#if defined COROUTINE_METRICS
+    assert(stats.enabled && stats.spawns == 2 && stats.resumes == 3 && stats.updates == 5);
+
+    // 每次等待一帧在就绪队列中1个tick，tick 3开始定时等待
+    if (manager.get_coroutine_stats(id, detail))
+        assert(detail.resumes == 3 && detail.suspended_ticks[(size_t)coroutine_slot::wait_kind::ready] == 3 &&
+            detail.suspended_ticks[(size_t)coroutine_slot::wait_kind::timer] == 2);
+#else
+    assert(!stats.enabled && !manager.get_coroutine_stats(id, detail));
+#endif
+
+    manager.destroy_coroutine(id);
+}
+
 void test_yield()
 {
     coroutine_manager coroutine_manager(get_tick_count());
@@ -96,12 +734,23 @@ void test_yield()
     float result = 10.0f;
     coroutine_manager::instance->trigger_event(1, &result);
 
-    while (true)
-    {
-        coroutine_manager::instance->update(get_tick_count());
-        if (!coroutine_manager::instance->exists_coroutine(wait_id))
-            break;
+    // 空闲时睡到下一个deadline，不再固定sleep轮询
+    coroutine_manager::instance->run_until([wait_id]() { return !coroutine_manager::instance->exists_coroutine(wait_id); });
 
-        sleep(10);
-    }
+    test_yield_generator();
+    test_yield_channel();
+    test_yield_scan();
+    test_yield_inbox();
+    test_yield_move_only();
+    test_yield_delivery();
+    test_yield_cascade();
+    test_yield_budget();
+    test_yield_cancel();
+    test_yield_run();
+    test_yield_metrics();
+
+#if defined COROUTINE_REACTOR
+    test_yield_io();
+    test_yield_io_timeout();
+#endif
 }
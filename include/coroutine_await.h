@@ -6,26 +6,100 @@
 #include <vector>
 #include <list>
 #include <queue>
+#include <unordered_map>
+#include <deque>
 #include <functional>
 #include <limits>
-#include <experimental/coroutine>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <optional>
+#include <exception>
+#include <type_traits>
 #include <assert.h>
 
+#include "coroutine_std.h"
+#include "coroutine_timer.h"
+#include "coroutine_pool.h"
+#include "coroutine_slot.h"
+#include "coroutine_scan.h"
+#include "coroutine_inbox.h"
+#include "coroutine_event.h"
+#include "coroutine_cancel.h"
+#include "coroutine_channel.h"
+#include "coroutine_metrics.h"
+#include "coroutine_reactor.h"
+
+#if defined COROUTINE_REACTOR
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
 namespace coroutine_await
 {
 #if defined _WIN64
 	typedef unsigned long long uint64_t;
 #endif
 
+	// 当前线程正在执行的协程管理器的tick
 	uint64_t get_cur_tick();
 
+	class coroutine_manager;
+
+	typedef coroutine_timer::duration_t duration_t;
+	typedef coroutine_event::delivery delivery;
+	typedef coroutine_cancel::cancellation_token cancellation_token;
+	typedef coroutine_cancel::cancellation_source cancellation_source;
+	typedef coroutine_metrics::coroutine_stats coroutine_stats;
+	typedef coroutine_metrics::manager_stats manager_stats;
+
 	class awaitable;
 
+	// 事件返回值类型的标记，同一event_id下按类型区分等待者，代替dynamic_cast
+	template<typename T>
+	inline const void* event_type()
+	{
+		return coroutine_event::type_tag<T>();
+	}
+
+	// 事件等待节点，按event_id挂入coroutine_manager的等待表
+	struct event_node : public coroutine_timer::list_node
+	{
+		awaitable* owner{ nullptr };
+		const void* type{ nullptr };
+	};
+
+#if defined COROUTINE_REACTOR
+	class io_awaitable;
+
+	// fd等待节点，挂入coroutine_manager的reactor
+	struct fd_node : public coroutine_reactor::io_node
+	{
+		io_awaitable* owner{ nullptr };
+	};
+#endif
+
+	// 依赖节点，挂入被等待协程的槽位，协程结束时通知owner
+	struct dependent_node : public coroutine_timer::list_node
+	{
+		awaitable* owner{ nullptr };
+		// 等待一组协程时的剩余数量，为0时owner就绪
+		size_t* remaining{ nullptr };
+	};
+
+	class sync_awaitable;
+
+	// 同步原语的等待节点，挂入async_mutex等的等待链表
+	struct sync_node : public coroutine_timer::list_node
+	{
+		sync_awaitable* owner{ nullptr };
+	};
+
 	struct coroutine_t
 	{
 		// 内部属性
 		struct promise_type;
-		using handle_type = std::experimental::coroutine_handle<promise_type>; //type alias
+		using handle_type = coroutine_std::coroutine_handle<promise_type>; //type alias
 
 		coroutine_t(handle_type h) :
 			handle(h), id(0)
@@ -54,12 +128,7 @@ namespace coroutine_await
 			if (!handle)
 				return true;
 
-			if (handle.done())
-				return true;
-
-			auto _promise = &handle.promise();
-
-			return handle.promise().awaitable_ptr == nullptr;
+			return handle.done();
 		}
 
 		bool close()
@@ -77,10 +146,26 @@ namespace coroutine_await
 		struct promise_type
 		{
 			awaitable* awaitable_ptr{ nullptr };
+			// 所属的管理器和协程id，由coroutine_manager::create_coroutine设置
+			coroutine_manager* manager{ nullptr };
+			uint64_t id{ 0 };
 
 			promise_type() { }
 			~promise_type() { }
 
+#if !defined COROUTINE_NO_FRAME_POOL
+			// 协程帧从内存池分配
+			static void* operator new(size_t size)
+			{
+				return coroutine_pool::frame_pool::allocate(size);
+			}
+
+			static void operator delete(void* ptr, size_t size)
+			{
+				coroutine_pool::frame_pool::deallocate(ptr, size);
+			}
+#endif
+
 			auto get_return_object()
 			{
 				awaitable_ptr = nullptr;
@@ -91,17 +176,16 @@ namespace coroutine_await
 			auto initial_suspend()
 			{
 				// 初始化协程时调用
-				// 返回suspend_never，表示协程创建后不用中断，直接执行
-				// 返回suspend_always，表示协程创建后中断，并不执行，使用handler.resume来执行
-				return std::experimental::suspend_never{};
+				// 返回suspend_always，协程创建后先中断，由create_coroutine绑定管理器后再执行
+				return coroutine_std::suspend_always{};
 			}
 
-			auto final_suspend()
+			auto final_suspend() noexcept
 			{
-				bool suspend = awaitable_ptr != nullptr;
+				// 协程结束后保持挂起，由coroutine_manager回收协程帧
 				awaitable_ptr = nullptr;
 
-				return std::experimental::suspend_if(suspend);
+				return coroutine_std::suspend_always{};
 			}
 
 			void return_void()
@@ -125,18 +209,253 @@ namespace coroutine_await
 		uint64_t id;
 	};
 
-	class awaitable
+	// task的promise，记录等待它的父协程和所在的顶层协程
+	class task_promise_base
+	{
+	public:
+#if !defined COROUTINE_NO_FRAME_POOL
+		static void* operator new(size_t size)
+		{
+			return coroutine_pool::frame_pool::allocate(size);
+		}
+
+		static void operator delete(void* ptr, size_t size)
+		{
+			coroutine_pool::frame_pool::deallocate(ptr, size);
+		}
+#endif
+
+		// 被co_await时才开始执行
+		auto initial_suspend()
+		{
+			return coroutine_std::suspend_always{};
+		}
+
+		// 结束时直接转移到父协程，不经过管理器，也不增加调用栈
+		struct final_awaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			template<typename Promise>
+			coroutine_std::coroutine_handle<> await_suspend(coroutine_std::coroutine_handle<Promise> _handle) noexcept
+			{
+				return _handle.promise().continuation;
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		final_awaiter final_suspend() noexcept
+		{
+			return final_awaiter{};
+		}
+
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		}
+
+		void rethrow_if_exception()
+		{
+			if (exception)
+				std::rethrow_exception(exception);
+		}
+
+		// 等待此task的父协程，结束时恢复
+		coroutine_std::coroutine_handle<> continuation;
+		// 所在的顶层协程，task中挂起时由它占用管理器的槽位
+		coroutine_t::handle_type root;
+
+	private:
+		std::exception_ptr exception;
+	};
+
+	template<typename T>
+	class task;
+
+	template<typename T>
+	class task_promise : public task_promise_base
+	{
+	public:
+		task<T> get_return_object();
+
+		template<typename U>
+		void return_value(U&& _value)
+		{
+			value.emplace(std::forward<U>(_value));
+		}
+
+		T take_value()
+		{
+			rethrow_if_exception();
+
+			return std::move(*value);
+		}
+
+	private:
+		std::optional<T> value;
+	};
+
+	template<>
+	class task_promise<void> : public task_promise_base
+	{
+	public:
+		task<void> get_return_object();
+
+		void return_void()
+		{
+		}
+
+		void take_value()
+		{
+			rethrow_if_exception();
+		}
+	};
+
+	// 挂起的协程帧和它所在的顶层协程，在顶层协程中挂起时两者相同
+	struct awaiting_handle
+	{
+		awaiting_handle(coroutine_t::handle_type _handle) :
+			frame(_handle), root(_handle)
+		{
+		}
+
+		template<typename T>
+		awaiting_handle(coroutine_std::coroutine_handle<task_promise<T>> _handle) :
+			frame(_handle), root(_handle.promise().root)
+		{
+		}
+
+		coroutine_std::coroutine_handle<> frame;
+		coroutine_t::handle_type root;
+	};
+
+	// 可以co_await的子协程，co_await时直接转移到子协程执行，结束时直接恢复父协程，
+	// 嵌套多层也在同一次update中完成。co_await返回子协程co_return的值
+	template<typename T = void>
+	class task
+	{
+	public:
+		typedef task_promise<T> promise_type;
+		typedef coroutine_std::coroutine_handle<promise_type> handle_type;
+
+		explicit task(handle_type _handle) : handle(_handle)
+		{
+		}
+
+		task(task&& other) noexcept : handle(other.handle)
+		{
+			other.handle = nullptr;
+		}
+
+		task& operator=(task&& other) noexcept
+		{
+			if (this != &other)
+			{
+				close();
+				handle = other.handle;
+				other.handle = nullptr;
+			}
+
+			return *this;
+		}
+
+		task(const task&) = delete;
+		task& operator=(const task&) = delete;
+
+		~task()
+		{
+			close();
+		}
+
+		bool is_done() const
+		{
+			return !handle || handle.done();
+		}
+
+		bool await_ready()
+		{
+			return is_done();
+		}
+
+		coroutine_std::coroutine_handle<> await_suspend(coroutine_t::handle_type _awaiting_handle)
+		{
+			return start(_awaiting_handle, _awaiting_handle);
+		}
+
+		template<typename U>
+		coroutine_std::coroutine_handle<> await_suspend(coroutine_std::coroutine_handle<task_promise<U>> _awaiting_handle)
+		{
+			return start(_awaiting_handle, _awaiting_handle.promise().root);
+		}
+
+		T await_resume()
+		{
+			return handle.promise().take_value();
+		}
+
+	private:
+		coroutine_std::coroutine_handle<> start(coroutine_std::coroutine_handle<> continuation, coroutine_t::handle_type root)
+		{
+			handle.promise().continuation = continuation;
+			handle.promise().root = root;
+
+			return handle;
+		}
+
+		void close()
+		{
+			if (handle)
+			{
+				handle.destroy();
+				handle = nullptr;
+			}
+		}
+
+		handle_type handle;
+	};
+
+	template<typename T>
+	inline task<T> task_promise<T>::get_return_object()
+	{
+		return task<T>{ task<T>::handle_type::from_promise(*this) };
+	}
+
+	inline task<void> task_promise<void>::get_return_object()
+	{
+		return task<void>{ task<void>::handle_type::from_promise(*this) };
+	}
+
+	// 挂起时按等待类型挂入时间轮或轮询链表
+	class awaitable : public coroutine_timer::timer_node
 	{
 	public:
-		awaitable() { handle = nullptr; }
+		awaitable() { handle = nullptr; frame = nullptr; }
+
+		virtual ~awaitable()
+		{
+			// 协程被销毁时从时间轮或轮询链表中摘除
+			unlink();
+		}
 
 		virtual bool can_resume() = 0;
 
+		// 恢复前从所有等待结构中摘除
+		virtual void detach()
+		{
+			unlink();
+		}
+
 		void resume()
 		{
-			if (handle != nullptr)
+			if (frame != nullptr)
 			{
-				handle.resume();
+				frame.resume();
 			}
 		}
 
@@ -148,32 +467,84 @@ namespace coroutine_await
 			return handle.done();
 		}
 
-	protected:
-		void on_suspend(coroutine_t::handle_type _awaiting_handle)
+		coroutine_t::handle_type get_handle() const
+		{
+			return handle;
+		}
+
+		// 所在协程被取消，等待没有完成就恢复
+		bool is_cancelled() const
+		{
+			return cancelled;
+		}
+
+		void mark_cancelled()
 		{
-			handle = _awaiting_handle;
-			handle.promise().set_awaitable(this);
+			cancelled = true;
 		}
 
+	protected:
+		// 记录挂起的协程和所属管理器，默认挂入轮询链表，每次update时检查can_resume
+		void on_suspend(awaiting_handle _awaiting_handle);
+
+		// 挂入时间轮，到达deadline时恢复
+		void wait_until(uint64_t deadline);
+
+		// 按所属管理器的tick精度换算出deadline后挂入时间轮
+		void wait_for(duration_t timeout);
+
+		// 挂入就绪队列，下一次update时恢复
+		void wait_ready();
+
+		// 挂入协程id的依赖链表，协程不存在时返回false
+		bool wait_coroutine(uint64_t id, dependent_node* node);
+
+		// 挂入event_id的等待表
+		void wait_event(int event_id, event_node* node);
+
+#if defined COROUTINE_REACTOR
+		// 挂入fd的等待链表，失败时返回-errno
+		int wait_io(fd_node* node, bool timed);
+
+		// 从fd的等待链表摘除
+		void leave_io(fd_node* node);
+#endif
+
+		// 所属管理器的当前tick
+		uint64_t get_tick() const;
+
+		// 从since到当前经过的秒数
+		float get_elapsed_seconds(uint64_t since) const;
+
+		// 挂起时从promise取得的所属管理器
+		coroutine_manager* manager{ nullptr };
+
 	private:
+		// 所在的顶层协程
 		coroutine_t::handle_type handle;
+		// 恢复时继续执行的协程帧，在task中挂起时是task的协程帧
+		coroutine_std::coroutine_handle<> frame;
+		bool cancelled{ false };
 	};
 
 	// 等待指定的时间
 	class wait_for_seconds : public awaitable
 	{
 	public:
-		wait_for_seconds(float seconds) : awaitable(), timeout_seconds(seconds)
+		wait_for_seconds(float seconds) : awaitable(), timeout(coroutine_timer::seconds_to_duration(seconds))
 		{
-			start_tick = get_cur_tick();
+			start_tick = 0;
 		}
 
-		virtual bool can_resume() override
+		template<typename Rep, typename Period>
+		wait_for_seconds(const std::chrono::duration<Rep, Period>& _timeout) : awaitable(), timeout(coroutine_timer::to_duration(_timeout))
 		{
-			uint64_t cur_tick = get_cur_tick();
-			uint64_t sep = cur_tick - start_tick;
+			start_tick = 0;
+		}
 
-			return (sep / 1000.0f >= timeout_seconds);
+		virtual bool can_resume() override
+		{
+			return awaitable::get_tick() >= deadline;
 		}
 
 		bool await_ready()
@@ -182,26 +553,24 @@ namespace coroutine_await
 			return false;
 		}
 
-		void await_suspend(coroutine_t::handle_type _awaiting_handle)
+		void await_suspend(awaiting_handle _awaiting_handle)
 		{
 			// 挂起awaitable。该函数会传入一个coroutine_handle类型的参数。这是一个由编译器生成的变量。在此函数中调用handle.resume()，就可以恢复协程
-			start_tick = get_cur_tick();
-
 			awaitable::on_suspend(_awaiting_handle);
+
+			start_tick = awaitable::get_tick();
+			awaitable::wait_for(timeout);
 		}
 
 		float await_resume()
 		{
 			// 当协程重新运行时，会调用该函数。这个函数的返回值就是co_await运算符的返回值。
-			uint64_t cur_tick = get_cur_tick();
-			float wait_seconds = (cur_tick - start_tick) / 1000.0f;
-
-			return wait_seconds;
+			return awaitable::get_elapsed_seconds(start_tick);
 		}
 
 	private:
 		uint64_t start_tick;
-		float timeout_seconds;
+		duration_t timeout;
 	};
 
 	// 等待下一帧
@@ -210,12 +579,12 @@ namespace coroutine_await
 	public:
 		wait_for_frame() : awaitable()
 		{
-			start_tick = get_cur_tick();
+			start_tick = 0;
 		}
 
 		virtual bool can_resume() override
 		{
-			uint64_t cur_tick = get_cur_tick();
+			uint64_t cur_tick = awaitable::get_tick();
 			return cur_tick > start_tick;
 		}
 
@@ -225,10 +594,13 @@ namespace coroutine_await
 			return false;
 		}
 
-		void await_suspend(coroutine_t::handle_type _awaiting_handle)
+		void await_suspend(awaiting_handle _awaiting_handle)
 		{
 			// 挂起awaitable。该函数会传入一个coroutine_handle类型的参数。这是一个由编译器生成的变量。在此函数中调用handle.resume()，就可以恢复协程
 			awaitable::on_suspend(_awaiting_handle);
+
+			start_tick = awaitable::get_tick();
+			awaitable::wait_ready();
 		}
 
 		void await_resume()
@@ -240,24 +612,25 @@ namespace coroutine_await
 		uint64_t start_tick;
 	};
 
-	// 等待指定的事件
+	// 等待指定的事件，事件的值直接存放在awaitable中，co_await返回该值，超时返回空
 	template<typename T>
 	class wait_for_event : public awaitable
 	{
 	public:
 		wait_for_event(int _event_id, float _seconds) :
-			awaitable(), event_id(_event_id), timeout_seconds(_seconds)
+			awaitable(), timeout(coroutine_timer::seconds_to_duration(_seconds)), event_id(_event_id)
 		{
-			return_value = nullptr;
-			start_tick = get_cur_tick();
 		}
 
-		virtual bool can_resume() override
+		template<typename Rep, typename Period>
+		wait_for_event(int _event_id, const std::chrono::duration<Rep, Period>& _timeout) :
+			awaitable(), timeout(coroutine_timer::to_duration(_timeout)), event_id(_event_id)
 		{
-			uint64_t cur_tick = get_cur_tick();
-			uint64_t sep = cur_tick - start_tick;
+		}
 
-			return (sep / 1000.0f >= timeout_seconds);
+		virtual bool can_resume() override
+		{
+			return awaitable::get_tick() >= deadline;
 		}
 
 		int get_event_id() const
@@ -265,9 +638,14 @@ namespace coroutine_await
 			return event_id;
 		}
 
-		void set_return_value(const T* _value)
+		void set_value(const T& _value)
+		{
+			value.emplace(_value);
+		}
+
+		void set_value(T&& _value)
 		{
-			return_value = _value;
+			value.emplace(std::move(_value));
 		}
 
 		bool await_ready()
@@ -276,26 +654,36 @@ namespace coroutine_await
 			return false;
 		}
 
-		void await_suspend(coroutine_t::handle_type _awaiting_handle)
+		void await_suspend(awaiting_handle _awaiting_handle)
 		{
 			// 挂起awaitable。该函数会传入一个coroutine_handle类型的参数。这是一个由编译器生成的变量。在此函数中调用handle.resume()，就可以恢复协程
-			start_tick = get_cur_tick();
-
 			awaitable::on_suspend(_awaiting_handle);
+
+			awaitable::wait_for(timeout);
+
+			event_waiter.owner = this;
+			event_waiter.type = event_type<T>();
+			awaitable::wait_event(event_id, &event_waiter);
 		}
 
-		const T* await_resume()
+		std::optional<T> await_resume()
 		{
 			// 当协程重新运行时，会调用该函数。这个函数的返回值就是co_await运算符的返回值。
-			return return_value;
+			return std::move(value);
+		}
+
+		virtual void detach() override
+		{
+			awaitable::detach();
+			event_waiter.unlink();
 		}
 
 	private:
-		// ms
-		uint64_t start_tick;
-		float timeout_seconds;
+		duration_t timeout;
 		int event_id;
-		const T* return_value;
+		std::optional<T> value;
+
+		event_node event_waiter;
 	};
 
 	// 等待指定的协程完成
@@ -314,10 +702,14 @@ namespace coroutine_await
 			return false;
 		}
 
-		void await_suspend(coroutine_t::handle_type _awaiting_handle)
+		void await_suspend(awaiting_handle _awaiting_handle)
 		{
 			// 挂起awaitable。该函数会传入一个coroutine_handle类型的参数。这是一个由编译器生成的变量。在此函数中调用handle.resume()，就可以恢复协程
 			awaitable::on_suspend(_awaiting_handle);
+
+			waiter.owner = this;
+			if (!awaitable::wait_coroutine(wait_coroutine_id, &waiter))
+				awaitable::wait_ready();
 		}
 
 		void await_resume()
@@ -325,8 +717,16 @@ namespace coroutine_await
 			// 当协程重新运行时，会调用该函数。这个函数的返回值就是co_await运算符的返回值。
 		}
 
+		virtual void detach() override
+		{
+			awaitable::detach();
+			waiter.unlink();
+		}
+
 	private:
 		uint64_t wait_coroutine_id;
+
+		dependent_node waiter;
 	};
 
 	// 等待指定的协程完成
@@ -345,10 +745,26 @@ namespace coroutine_await
 			return false;
 		}
 
-		void await_suspend(coroutine_t::handle_type _awaiting_handle)
+		void await_suspend(awaiting_handle _awaiting_handle)
 		{
 			// 挂起awaitable。该函数会传入一个coroutine_handle类型的参数。这是一个由编译器生成的变量。在此函数中调用handle.resume()，就可以恢复协程
 			awaitable::on_suspend(_awaiting_handle);
+
+			// 每个仍在运行的协程一个依赖节点，最后一个结束时就绪
+			waiters.resize(count);
+			remaining = 0;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				waiters[i].owner = this;
+				waiters[i].remaining = &remaining;
+
+				if (awaitable::wait_coroutine(wait_coroutine_groups[i], &waiters[i]))
+					++remaining;
+			}
+
+			if (remaining == 0)
+				awaitable::wait_ready();
 		}
 
 		void await_resume()
@@ -356,183 +772,2173 @@ namespace coroutine_await
 			// 当协程重新运行时，会调用该函数。这个函数的返回值就是co_await运算符的返回值。
 		}
 
+		virtual void detach() override
+		{
+			awaitable::detach();
+
+			for (size_t i = 0; i < waiters.size(); i++)
+				waiters[i].unlink();
+		}
+
 	private:
 		uint64_t* wait_coroutine_groups;
 		size_t count;
+
+		std::vector<dependent_node> waiters;
+		size_t remaining{ 0 };
 	};
 
-	class coroutine_manager
+	// 不挂起，返回正在运行的协程是否已被取消
+	class check_cancelled
 	{
 	public:
-		static coroutine_manager* instance;
-
-	public:
-		coroutine_manager(uint64_t tick) : cur_tick(tick)
+		bool await_ready()
 		{
+			return true;
 		}
 
-		~coroutine_manager()
+		void await_suspend(coroutine_std::coroutine_handle<>)
 		{
+		}
+
+		bool await_resume();
+	};
 
+	// 等待同步原语，挂入同步原语的等待链表，由同步原语直接交给等待者后恢复，不参与轮询
+	class sync_awaitable : public awaitable
+	{
+	public:
+		sync_awaitable() : awaitable() { }
+
+		virtual bool can_resume() override
+		{
+			return granted;
 		}
 
-		uint64_t get_tick() const
+		// 同步原语交出所有权或已完成，下一次update恢复，cascade时在本次update中恢复
+		void grant();
+
+		bool is_granted() const
 		{
-			return cur_tick;
+			return granted;
 		}
 
-		void update(uint64_t tick)
+		// 按挂起顺序唤醒链表中的全部等待者
+		static void grant_all(coroutine_timer::intrusive_list& waiters);
+
+		virtual void detach() override
 		{
-			cur_tick = tick;
+			awaitable::detach();
+			waiter.unlink();
+		}
 
-			for (size_t i = 0; i < coroutines.size(); i++)
-			{
-				if (coroutines[i].is_done())
-				{
-					if (coroutines[i].handle != nullptr)
-					{
-						coroutines[i].close();
-						free_indexes.emplace(i);
-					}
+	protected:
+		// 挂入同步原语的等待链表
+		void wait_sync(coroutine_timer::intrusive_list& waiters);
 
+		sync_node waiter;
+		bool granted{ false };
+	};
+
+	class async_mutex;
+	class async_semaphore;
+	class async_latch;
+	class async_barrier;
+
+	// 等待得到async_mutex，co_await返回是否得到，等待中被取消时返回false
+	class wait_for_mutex : public sync_awaitable
+	{
+	public:
+		explicit wait_for_mutex(async_mutex& _mutex) : sync_awaitable(), mutex(&_mutex) { }
+
+		// 得到锁后没有恢复就被销毁时归还
+		~wait_for_mutex();
+
+		bool await_ready();
+
+		void await_suspend(awaiting_handle _awaiting_handle);
+
+		bool await_resume()
+		{
+			resumed = true;
+			return granted;
+		}
+
+	private:
+		async_mutex* mutex;
+		bool resumed{ false };
+	};
+
+	// 等待async_semaphore的一个计数，co_await返回是否得到，等待中被取消时返回false
+	class wait_for_semaphore : public sync_awaitable
+	{
+	public:
+		explicit wait_for_semaphore(async_semaphore& _semaphore) : sync_awaitable(), semaphore(&_semaphore) { }
+
+		// 得到计数后没有恢复就被销毁时归还
+		~wait_for_semaphore();
+
+		bool await_ready();
+
+		void await_suspend(awaiting_handle _awaiting_handle);
+
+		bool await_resume()
+		{
+			resumed = true;
+			return granted;
+		}
+
+	private:
+		async_semaphore* semaphore;
+		bool resumed{ false };
+	};
+
+	// 等待async_latch计数到0，co_await返回是否已到0，等待中被取消时返回false
+	class wait_for_latch : public sync_awaitable
+	{
+	public:
+		explicit wait_for_latch(async_latch& _latch) : sync_awaitable(), latch(&_latch) { }
+
+		bool await_ready();
+
+		void await_suspend(awaiting_handle _awaiting_handle);
+
+		bool await_resume()
+		{
+			return granted;
+		}
+
+	private:
+		async_latch* latch;
+	};
+
+	// 等待async_barrier的当前阶段完成，co_await返回是否已完成，等待中被取消时返回false
+	class wait_for_barrier : public sync_awaitable
+	{
+	public:
+		wait_for_barrier(async_barrier& _barrier, uint64_t _phase) : sync_awaitable(), barrier(&_barrier), phase(_phase) { }
+
+		bool await_ready();
+
+		void await_suspend(awaiting_handle _awaiting_handle);
+
+		bool await_resume()
+		{
+			return granted;
+		}
+
+	private:
+		async_barrier* barrier;
+		// 到达时的阶段，阶段变化后就绪
+		uint64_t phase;
+	};
+
+	// 协程互斥锁，解锁时直接交给最早挂起的等待者，等待期间不占用update
+	// 只能在所属协程管理器的线程使用，析构时不能还有等待者
+	class async_mutex
+	{
+	public:
+		async_mutex() { }
+
+		async_mutex(const async_mutex&) = delete;
+		async_mutex& operator=(const async_mutex&) = delete;
+
+		// co_await mutex.lock()，得到后需要unlock，也可以交给std::lock_guard(mutex, std::adopt_lock)
+		wait_for_mutex lock()
+		{
+			return wait_for_mutex(*this);
+		}
+
+		bool try_lock()
+		{
+			if (locked)
+				return false;
+
+			locked = true;
+			return true;
+		}
+
+		// 有等待者时锁保持占用，所有权交给最早的等待者
+		void unlock()
+		{
+			assert(locked);
+
+			if (!waiters.empty())
+			{
+				static_cast<sync_node*>(waiters.pop_front())->owner->grant();
+				return;
+			}
+
+			locked = false;
+		}
+
+		bool is_locked() const
+		{
+			return locked;
+		}
+
+	private:
+		friend class wait_for_mutex;
+
+		bool locked{ false };
+		coroutine_timer::intrusive_list waiters;
+	};
+
+	// 协程计数信号量，释放时直接交给最早挂起的等待者，有等待者时计数一定为0
+	class async_semaphore
+	{
+	public:
+		explicit async_semaphore(size_t initial) : count(initial) { }
+
+		async_semaphore(const async_semaphore&) = delete;
+		async_semaphore& operator=(const async_semaphore&) = delete;
+
+		// co_await semaphore.acquire()，得到后需要release
+		wait_for_semaphore acquire()
+		{
+			return wait_for_semaphore(*this);
+		}
+
+		bool try_acquire()
+		{
+			if (count == 0)
+				return false;
+
+			--count;
+			return true;
+		}
+
+		// 先交给等待者，剩余的加入计数
+		void release(size_t n = 1)
+		{
+			while (n > 0 && !waiters.empty())
+			{
+				static_cast<sync_node*>(waiters.pop_front())->owner->grant();
+				--n;
+			}
+
+			count += n;
+		}
+
+		size_t available() const
+		{
+			return count;
+		}
+
+	private:
+		friend class wait_for_semaphore;
+
+		size_t count;
+		coroutine_timer::intrusive_list waiters;
+	};
+
+	// 一次性的倒数计数，减到0时唤醒全部等待者
+	class async_latch
+	{
+	public:
+		explicit async_latch(size_t _count) : count(_count) { }
+
+		async_latch(const async_latch&) = delete;
+		async_latch& operator=(const async_latch&) = delete;
+
+		// n超过剩余计数时按剩余计数处理，已到0后再调用不起作用
+		void count_down(size_t n = 1)
+		{
+			if (count == 0)
+				return;
+
+			count -= n < count ? n : count;
+			if (count == 0)
+				sync_awaitable::grant_all(waiters);
+		}
+
+		bool try_wait() const
+		{
+			return count == 0;
+		}
+
+		// co_await latch.wait()
+		wait_for_latch wait()
+		{
+			return wait_for_latch(*this);
+		}
+
+		// 先count_down再等待
+		wait_for_latch arrive_and_wait(size_t n = 1)
+		{
+			count_down(n);
+			return wait_for_latch(*this);
+		}
+
+	private:
+		friend class wait_for_latch;
+
+		size_t count;
+		coroutine_timer::intrusive_list waiters;
+	};
+
+	// 可重复使用的屏障，每个阶段全部参与者到达后唤醒本阶段的等待者，最后到达的不挂起
+	class async_barrier
+	{
+	public:
+		explicit async_barrier(size_t _expected) : expected(_expected) { }
+
+		async_barrier(const async_barrier&) = delete;
+		async_barrier& operator=(const async_barrier&) = delete;
+
+		// 到达并等待本阶段完成，到达在调用时计入
+		wait_for_barrier arrive_and_wait()
+		{
+			uint64_t arrived_phase = phase;
+			arrive();
+
+			return wait_for_barrier(*this, arrived_phase);
+		}
+
+		// 到达后退出，之后的阶段少等待一个参与者，最后一个参与者退出时不完成任何阶段
+		void arrive_and_drop()
+		{
+			if (expected == 0)
+				return;
+
+			--expected;
+			if (expected > 0 && arrived >= expected)
+				complete_phase();
+		}
+
+		// 已完成的阶段数
+		uint64_t get_phase() const
+		{
+			return phase;
+		}
+
+	private:
+		friend class wait_for_barrier;
+
+		// 没有参与者时到达不完成阶段
+		void arrive()
+		{
+			if (++arrived >= expected && expected > 0)
+				complete_phase();
+		}
+
+		void complete_phase()
+		{
+			arrived = 0;
+			++phase;
+			sync_awaitable::grant_all(waiters);
+		}
+
+		size_t expected;
+		size_t arrived{ 0 };
+		uint64_t phase{ 0 };
+		coroutine_timer::intrusive_list waiters;
+	};
+
+	template<typename T>
+	class channel;
+
+	// 通道的接收等待者，发送时值直接交给最早挂起的接收者
+	template<typename T>
+	class channel_receiver : public sync_awaitable
+	{
+	public:
+		virtual void deliver(T&& _value) = 0;
+	};
+
+	// 向通道发送一个值，缓冲满时挂起，co_await返回是否已发送，通道关闭或等待中被取消时返回false
+	template<typename T>
+	class wait_for_send : public sync_awaitable
+	{
+	public:
+		template<typename U>
+		wait_for_send(channel<T>& _channel, U&& _value) : sync_awaitable(), target(&_channel), value(std::forward<U>(_value)) { }
+
+		bool await_ready()
+		{
+			sent = target->try_send(std::move(value));
+			return sent || target->is_closed();
+		}
+
+		void await_suspend(awaiting_handle _awaiting_handle)
+		{
+			awaitable::on_suspend(_awaiting_handle);
+			sync_awaitable::wait_sync(target->senders);
+		}
+
+		bool await_resume()
+		{
+			return sent;
+		}
+
+	private:
+		friend class channel<T>;
+
+		// 缓冲空出位置时由通道取走
+		T take()
+		{
+			sent = true;
+			return std::move(value);
+		}
+
+		channel<T>* target;
+		T value;
+		bool sent{ false };
+	};
+
+	// 从通道接收一个值，缓冲空时挂起，通道关闭且缓冲已取完或等待中被取消时返回空
+	template<typename T>
+	class wait_for_receive : public channel_receiver<T>
+	{
+	public:
+		explicit wait_for_receive(channel<T>& _channel) : channel_receiver<T>(), target(&_channel) { }
+
+		// 交到值后没有恢复就被销毁时退回通道
+		~wait_for_receive()
+		{
+			if (this->granted && !resumed && value.has_value())
+				target->restore(std::move(*value));
+		}
+
+		bool await_ready()
+		{
+			value = target->try_receive();
+			return value.has_value() || target->is_closed();
+		}
+
+		void await_suspend(awaiting_handle _awaiting_handle)
+		{
+			awaitable::on_suspend(_awaiting_handle);
+			sync_awaitable::wait_sync(target->receivers);
+		}
+
+		std::optional<T> await_resume()
+		{
+			resumed = true;
+			return std::move(value);
+		}
+
+		virtual void deliver(T&& _value) override
+		{
+			value.emplace(std::move(_value));
+		}
+
+	private:
+		channel<T>* target;
+		std::optional<T> value;
+		bool resumed{ false };
+	};
+
+	// 从通道批量接收，至少有一个值时不挂起，最多取max_count个追加到output，co_await返回取到的数量
+	template<typename T>
+	class wait_for_receive_many : public channel_receiver<T>
+	{
+	public:
+		wait_for_receive_many(channel<T>& _channel, std::vector<T>& _output, size_t _max_count) :
+			channel_receiver<T>(), target(&_channel), output(&_output), max_count(_max_count)
+		{
+			assert(max_count > 0);
+		}
+
+		// 交到值后没有恢复就被销毁时从output中取回，退回通道
+		~wait_for_receive_many()
+		{
+			if (!this->granted || resumed)
+				return;
+
+			for (; count > 0; --count)
+			{
+				target->restore(std::move(output->back()));
+				output->pop_back();
+			}
+		}
+
+		bool await_ready()
+		{
+			count = target->try_receive_many(*output, max_count);
+			return count > 0 || target->is_closed();
+		}
+
+		void await_suspend(awaiting_handle _awaiting_handle)
+		{
+			awaitable::on_suspend(_awaiting_handle);
+			sync_awaitable::wait_sync(target->receivers);
+		}
+
+		size_t await_resume()
+		{
+			resumed = true;
+
+			// 被唤醒后顺带取走期间缓冲的值
+			if (count > 0 && count < max_count && !awaitable::is_cancelled())
+				count += target->try_receive_many(*output, max_count - count);
+
+			return count;
+		}
+
+		virtual void deliver(T&& _value) override
+		{
+			output->push_back(std::move(_value));
+			++count;
+		}
+
+	private:
+		channel<T>* target;
+		std::vector<T>* output;
+		size_t max_count;
+		size_t count{ 0 };
+		bool resumed{ false };
+	};
+
+	// 有界通道，协程之间按发送顺序传递值，缓冲满时发送者挂起，空时接收者挂起
+	// 有接收者等待时值直接交给最早的接收者，接收后缓冲空出的位置直接由最早等待的发送者填入
+	// 容量为0时不缓冲，发送者等到接收者取走值，先到的一方挂起等待另一方
+	// 任意数量的协程可以同时发送和接收，只能在所属协程管理器的线程使用，析构时不能还有等待者
+	template<typename T>
+	class channel
+	{
+	public:
+		explicit channel(size_t capacity) : buffer(capacity) { }
+
+		channel(const channel&) = delete;
+		channel& operator=(const channel&) = delete;
+
+		// co_await ch.send(value)
+		template<typename U>
+		wait_for_send<T> send(U&& value)
+		{
+			return wait_for_send<T>(*this, std::forward<U>(value));
+		}
+
+		// co_await ch.receive()
+		wait_for_receive<T> receive()
+		{
+			return wait_for_receive<T>(*this);
+		}
+
+		// co_await ch.receive_many(output, max_count)
+		wait_for_receive_many<T> receive_many(std::vector<T>& output, size_t max_count)
+		{
+			return wait_for_receive_many<T>(*this, output, max_count);
+		}
+
+		// 不挂起的发送，缓冲满或已关闭时返回false，此时value不会被移走
+		template<typename U>
+		bool try_send(U&& value)
+		{
+			if (closed)
+				return false;
+
+			// 有接收者等待时缓冲一定为空
+			if (!receivers.empty())
+			{
+				hand_over(T(std::forward<U>(value)));
+				return true;
+			}
+
+			if (buffer.full())
+				return false;
+
+			buffer.push(std::forward<U>(value));
+			return true;
+		}
+
+		// 不挂起的接收，缓冲为空时返回空
+		std::optional<T> try_receive()
+		{
+			// 容量为0时直接从最早等待的发送者取值
+			if (buffer.empty())
+			{
+				if (senders.empty())
+					return std::nullopt;
+
+				return std::optional<T>(take_sender());
+			}
+
+			std::optional<T> value(buffer.pop());
+			refill();
+
+			return value;
+		}
+
+		// 最多取max_count个追加到output，返回取到的数量
+		size_t try_receive_many(std::vector<T>& output, size_t max_count)
+		{
+			size_t count = 0;
+
+			while (count < max_count)
+			{
+				if (!buffer.empty())
+				{
+					output.push_back(buffer.pop());
+					refill();
+				}
+				else if (!senders.empty())
+					output.push_back(take_sender());
+				else
+					break;
+
+				++count;
+			}
+
+			return count;
+		}
+
+		// 关闭后不能再发送，等待中的发送者返回false，缓冲中的值仍可以接收，取完后接收者返回空
+		void close()
+		{
+			closed = true;
+
+			sync_awaitable::grant_all(senders);
+			sync_awaitable::grant_all(receivers);
+		}
+
+		bool is_closed() const
+		{
+			return closed;
+		}
+
+		size_t size() const
+		{
+			return buffer.size();
+		}
+
+		size_t capacity() const
+		{
+			return buffer.capacity();
+		}
+
+	private:
+		friend class wait_for_send<T>;
+		friend class wait_for_receive<T>;
+		friend class wait_for_receive_many<T>;
+
+		// 缓冲空出位置时移入最早等待的发送者的值，有退回的值时缓冲可能仍是满的
+		void refill()
+		{
+			if (!senders.empty() && !buffer.full())
+				buffer.push(take_sender());
+		}
+
+		// 值直接交给最早等待的接收者
+		void hand_over(T&& value)
+		{
+			channel_receiver<T>* receiver = static_cast<channel_receiver<T>*>(static_cast<sync_node*>(receivers.pop_front())->owner);
+			receiver->deliver(std::move(value));
+			receiver->grant();
+		}
+
+		// 接收者拿到值后没有恢复就被销毁，值交给下一个等待的接收者，没有时放回缓冲头部
+		void restore(T&& value)
+		{
+			if (!receivers.empty())
+				hand_over(std::move(value));
+			else
+				buffer.push_front(std::move(value));
+		}
+
+		// 取走最早等待的发送者的值并唤醒它
+		T take_sender()
+		{
+			wait_for_send<T>* sender = static_cast<wait_for_send<T>*>(static_cast<sync_node*>(senders.pop_front())->owner);
+			T value(sender->take());
+			sender->grant();
+
+			return value;
+		}
+
+		coroutine_channel::ring_buffer<T> buffer;
+		bool closed{ false };
+		coroutine_timer::intrusive_list senders;
+		coroutine_timer::intrusive_list receivers;
+	};
+
+#if defined COROUTINE_REACTOR
+	// 等待fd就绪后完成一次非阻塞io，先直接尝试，不能完成时才挂起，fd需要设为非阻塞
+	// 没有指定超时时一直等待，只由reactor唤醒，不参与轮询
+	class io_awaitable : public awaitable
+	{
+	public:
+		io_awaitable(int _fd, coroutine_reactor::io_event _event, float _seconds) :
+			awaitable(), timeout(coroutine_timer::seconds_to_duration(_seconds < 0.0f ? 0.0f : _seconds)), timed(_seconds >= 0.0f)
+		{
+			io_waiter.fd = _fd;
+			io_waiter.event = _event;
+		}
+
+		template<typename Rep, typename Period>
+		io_awaitable(int _fd, coroutine_reactor::io_event _event, const std::chrono::duration<Rep, Period>& _timeout) :
+			awaitable(), timeout(coroutine_timer::to_duration(_timeout)), timed(true)
+		{
+			io_waiter.fd = _fd;
+			io_waiter.event = _event;
+		}
+
+		// 协程被销毁时从reactor中摘除
+		~io_awaitable()
+		{
+			if (io_waiter.is_linked())
+				awaitable::leave_io(&io_waiter);
+		}
+
+		virtual bool can_resume() override
+		{
+			return timed && awaitable::get_tick() >= deadline;
+		}
+
+		bool await_ready()
+		{
+			completed = try_io(false);
+			return completed;
+		}
+
+		void await_suspend(awaiting_handle _awaiting_handle)
+		{
+			awaitable::on_suspend(_awaiting_handle);
+
+			if (timed)
+				awaitable::wait_for(timeout);
+
+			io_waiter.owner = this;
+
+			int error = awaitable::wait_io(&io_waiter, timed);
+			if (error != 0)
+			{
+				result = error;
+				completed = true;
+				awaitable::wait_ready();
+			}
+		}
+
+		// reactor通知fd就绪时调用，io完成后挂入就绪队列，返回false时继续等待
+		bool on_ready()
+		{
+			if (!try_io(true))
+				return false;
+
+			completed = true;
+			awaitable::wait_ready();
+
+			return true;
+		}
+
+		virtual void detach() override
+		{
+			awaitable::detach();
+
+			// 超时或被取消时还在等待链表中
+			if (io_waiter.is_linked())
+				awaitable::leave_io(&io_waiter);
+		}
+
+		int get_fd() const
+		{
+			return io_waiter.fd;
+		}
+
+	protected:
+		// 执行一次非阻塞io，ready为false时是挂起前的尝试，返回false表示需要等待
+		virtual bool try_io(bool ready) = 0;
+
+		// 记录io的返回值，失败时转为-errno，需要等待时返回false
+		bool set_result(ssize_t _result)
+		{
+			if (_result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				return false;
+
+			result = _result < 0 ? -errno : _result;
+			return true;
+		}
+
+		// 没有完成时被取消返回-ECANCELED，超时返回-ETIMEDOUT
+		ssize_t get_result() const
+		{
+			if (completed)
+				return result;
+
+			return awaitable::is_cancelled() ? -ECANCELED : -ETIMEDOUT;
+		}
+
+	private:
+		duration_t timeout;
+		bool timed;
+		bool completed{ false };
+		ssize_t result{ 0 };
+
+		fd_node io_waiter;
+	};
+
+	// 等待fd可读，超时、被取消或出错时返回false
+	class wait_for_readable : public io_awaitable
+	{
+	public:
+		wait_for_readable(int _fd, float _seconds = -1.0f) : io_awaitable(_fd, coroutine_reactor::io_readable, _seconds)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_readable(int _fd, const std::chrono::duration<Rep, Period>& _timeout) : io_awaitable(_fd, coroutine_reactor::io_readable, _timeout)
+		{
+		}
+
+		bool await_resume()
+		{
+			return io_awaitable::get_result() >= 0;
+		}
+
+	protected:
+		virtual bool try_io(bool ready) override
+		{
+			return ready;
+		}
+	};
+
+	// 等待fd可写，超时、被取消或出错时返回false
+	class wait_for_writable : public io_awaitable
+	{
+	public:
+		wait_for_writable(int _fd, float _seconds = -1.0f) : io_awaitable(_fd, coroutine_reactor::io_writable, _seconds)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_writable(int _fd, const std::chrono::duration<Rep, Period>& _timeout) : io_awaitable(_fd, coroutine_reactor::io_writable, _timeout)
+		{
+		}
+
+		bool await_resume()
+		{
+			return io_awaitable::get_result() >= 0;
+		}
+
+	protected:
+		virtual bool try_io(bool ready) override
+		{
+			return ready;
+		}
+	};
+
+	// 读取最多size字节，co_await返回读到的字节数，0表示对端已关闭，失败时返回-errno
+	class async_read : public io_awaitable
+	{
+	public:
+		async_read(int _fd, void* _buffer, size_t _size, float _seconds = -1.0f) :
+			io_awaitable(_fd, coroutine_reactor::io_readable, _seconds), buffer(_buffer), size(_size)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		async_read(int _fd, void* _buffer, size_t _size, const std::chrono::duration<Rep, Period>& _timeout) :
+			io_awaitable(_fd, coroutine_reactor::io_readable, _timeout), buffer(_buffer), size(_size)
+		{
+		}
+
+		ssize_t await_resume()
+		{
+			return io_awaitable::get_result();
+		}
+
+	protected:
+		virtual bool try_io(bool) override
+		{
+			return io_awaitable::set_result(::read(io_awaitable::get_fd(), buffer, size));
+		}
+
+	private:
+		void* buffer;
+		size_t size;
+	};
+
+	// 写入最多size字节，co_await返回写入的字节数，可能少于size，失败时返回-errno
+	class async_write : public io_awaitable
+	{
+	public:
+		async_write(int _fd, const void* _buffer, size_t _size, float _seconds = -1.0f) :
+			io_awaitable(_fd, coroutine_reactor::io_writable, _seconds), buffer(_buffer), size(_size)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		async_write(int _fd, const void* _buffer, size_t _size, const std::chrono::duration<Rep, Period>& _timeout) :
+			io_awaitable(_fd, coroutine_reactor::io_writable, _timeout), buffer(_buffer), size(_size)
+		{
+		}
+
+		ssize_t await_resume()
+		{
+			return io_awaitable::get_result();
+		}
+
+	protected:
+		virtual bool try_io(bool) override
+		{
+			return io_awaitable::set_result(::write(io_awaitable::get_fd(), buffer, size));
+		}
+
+	private:
+		const void* buffer;
+		size_t size;
+	};
+
+	// 接受一个连接，co_await返回非阻塞的新fd，失败时返回-errno
+	class async_accept : public io_awaitable
+	{
+	public:
+		async_accept(int _fd, float _seconds = -1.0f) : io_awaitable(_fd, coroutine_reactor::io_readable, _seconds)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		async_accept(int _fd, const std::chrono::duration<Rep, Period>& _timeout) : io_awaitable(_fd, coroutine_reactor::io_readable, _timeout)
+		{
+		}
+
+		int await_resume()
+		{
+			return (int)io_awaitable::get_result();
+		}
+
+	protected:
+		virtual bool try_io(bool) override
+		{
+			return io_awaitable::set_result(::accept4(io_awaitable::get_fd(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+		}
+	};
+#endif
+
+	// 定时等待的处理方式
+	enum class timer_mode
+	{
+		// 挂入时间轮，update只处理到期的节点，按deadline顺序恢复
+		wheel,
+		// 只记录在槽位表的deadline列，update时批量扫描，按槽位顺序恢复
+		scan,
+	};
+
+	// 协程结束时等待它的协程何时恢复
+	enum class resume_mode
+	{
+		// 挂入就绪队列，下一次update时恢复，依赖链每层延迟一帧
+		next_update,
+		// 在同一次update中接着恢复，依赖链在一次update内完成，与槽位顺序无关
+		cascade,
+	};
+
+	typedef coroutine_slot::priority priority;
+
+	// 一次update的预算，用完后剩余的恢复留到下一次update，按优先级先恢复critical
+	struct update_budget
+	{
+		// 最多恢复的协程数量
+		size_t resumes{ std::numeric_limits<size_t>::max() };
+		// 最长执行时间，为0时不限制
+		std::chrono::microseconds time{ 0 };
+
+		static update_budget unlimited()
+		{
+			return update_budget{};
+		}
+
+		static update_budget resumes_at_most(size_t count)
+		{
+			return update_budget{ count, std::chrono::microseconds(0) };
+		}
+
+		static update_budget time_slice(std::chrono::microseconds time)
+		{
+			return update_budget{ std::numeric_limits<size_t>::max(), time };
+		}
+	};
+
+	class coroutine_manager
+	{
+	public:
+		// 未通过create_coroutine绑定时使用的默认管理器，可以为空
+		static coroutine_manager* instance;
+
+		// 当前线程正在执行协程的管理器，不在管理器内时返回instance
+		static coroutine_manager* get_current()
+		{
+			return current != nullptr ? current : instance;
+		}
+
+	public:
+		// ticks_per_second为tick的精度，默认毫秒，可用微秒(1000000)或纳秒(1000000000)
+		// inbox_capacity为其他线程投递事件的队列容量
+		coroutine_manager(uint64_t tick, uint64_t _ticks_per_second = coroutine_timer::default_ticks_per_second,
+			size_t inbox_capacity = coroutine_inbox::mpsc_queue<int>::default_capacity) :
+			cur_tick(tick), ticks_per_second(_ticks_per_second), inbox(inbox_capacity), timers(tick)
+		{
+			assert(ticks_per_second > 0 && ticks_per_second <= 1000000000);
+		}
+
+		~coroutine_manager()
+		{
+			// 未处理的投递只释放不触发
+			posted_event posted;
+			while (inbox.try_pop(posted))
+				posted.payload.reset();
+
+			// 剩余协程帧在此销毁，awaitable析构时自动从等待结构中摘除
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) != coroutine_slot::slot_state::free)
+					close_slot(i);
+			}
+		}
+
+		uint64_t get_tick() const
+		{
+			return cur_tick;
+		}
+
+		uint64_t get_ticks_per_second() const
+		{
+			return ticks_per_second;
+		}
+
+		// 当前tick之后timeout的绝对deadline
+		uint64_t get_deadline(duration_t timeout) const
+		{
+			return coroutine_timer::add_ticks(cur_tick, coroutine_timer::duration_to_ticks(timeout, ticks_per_second));
+		}
+
+		// 返回下一次需要update的tick，见get_next_wakeup
+		uint64_t update(uint64_t tick)
+		{
+			return update(tick, update_budget::unlimited());
+		}
+
+		// 超出预算时剩余的恢复留在运行队列，下一次update优先处理
+		uint64_t update(uint64_t tick, update_budget budget)
+		{
+			current_scope scope(this);
+
+			cur_tick = tick;
+			metrics.begin_update();
+
+			// 其他线程投递的事件
+			drain_inbox();
+
+#if defined COROUTINE_REACTOR
+			// fd就绪的等待在此完成io，和就绪队列一起恢复
+			poll_io(0);
+#endif
+
+			// 只处理到期的定时等待
+			coroutine_timer::intrusive_list expired;
+			timers.advance(tick, expired);
+
+			while (!expired.empty())
+			{
+				enqueue(static_cast<awaitable*>(expired.pop_front()));
+			}
+
+			if (mode == timer_mode::scan)
+				enqueue_expired_slots(tick);
+
+			// 就绪队列，本帧新加入的留到下一帧
+			coroutine_timer::intrusive_list queued;
+			queued.splice(ready);
+			queued.splice(woken);
+
+			while (!queued.empty())
+			{
+				enqueue(static_cast<awaitable*>(queued.pop_front()));
+			}
+
+			budget_meter meter(budget);
+			run_queues(meter);
+
+			// 轮询的等待，本帧新挂起的留到下一帧
+			coroutine_timer::intrusive_list pending;
+			pending.splice(polling);
+
+			while (!pending.empty())
+			{
+				awaitable* _awaitable = static_cast<awaitable*>(pending.pop_front());
+
+				if (_awaitable->can_resume())
+					enqueue(_awaitable);
+				else
+					polling.push_back(_awaitable);
+			}
+
+			run_queues(meter);
+
+			// 本次update中结束的协程唤醒的等待者，超出预算的留到下一次update
+			size_t cascade_budget = resume_budget;
+			while (!woken.empty() && cascade_budget > 0 && meter.take())
+			{
+				--cascade_budget;
+				resume_awaitable(static_cast<awaitable*>(woken.pop_front()));
+			}
+
+			ready.splice(woken);
+
+			metrics.end_update();
+			return get_next_wakeup();
+		}
+
+		// 没有任何需要按时间唤醒的等待
+		static constexpr uint64_t no_wakeup = std::numeric_limits<uint64_t>::max();
+
+		// 最早需要再次update的tick，有待恢复的协程时为当前tick，有轮询的等待时为下一个tick，
+		// 其余按最早的deadline，自己驱动循环的宿主可以据此睡眠
+		uint64_t get_next_wakeup() const
+		{
+			if (!ready.empty() || !woken.empty() || !inbox.empty())
+				return cur_tick;
+
+			for (size_t i = 0; i < coroutine_slot::priority_count; i++)
+			{
+				if (!queues[i].empty())
+					return cur_tick;
+			}
+
+			if (!polling.empty())
+				return coroutine_timer::add_ticks(cur_tick, 1);
+
+			if (mode == timer_mode::scan)
+				return coroutine_scan::min_deadline(slots.get_deadlines(), slots.size());
+
+			return timers.next_expiry();
+		}
+
+		// 阻塞运行直到stop，见run_until
+		void run()
+		{
+			run_until([]() { return false; });
+		}
+
+		// 阻塞运行，每次update后done返回true或调用了stop时返回
+		// tick按steady_clock从当前tick接着推进，空闲时睡到下一个deadline，fd就绪、post_event和wake会提前唤醒
+		template<typename Predicate>
+		void run_until(Predicate done)
+		{
+			typedef std::chrono::steady_clock clock;
+
+			clock::time_point start_time = clock::now();
+			uint64_t start_tick = cur_tick;
+
+			while (true)
+			{
+				uint64_t tick = start_tick + coroutine_timer::elapsed_ticks(clock::now() - start_time, ticks_per_second);
+				uint64_t next = update(tick);
+
+				if (done() || stopping.exchange(false, std::memory_order_acquire))
+					return;
+
+				if (next <= tick)
 					continue;
+
+				duration_t delay = coroutine_timer::ticks_to_duration(next - start_tick, ticks_per_second);
+				if (next == no_wakeup || delay >= clock::time_point::max() - start_time)
+				{
+					wait_idle(nullptr);
+				}
+				else
+				{
+					clock::time_point deadline = start_time + std::chrono::duration_cast<clock::duration>(delay);
+					wait_idle(&deadline);
 				}
+			}
+		}
+
+		// 让run在本次update后返回，可以在任意线程调用，不在run中时下一次run只执行一次update
+		void stop()
+		{
+			stopping.store(true, std::memory_order_release);
+			io.wake();
+		}
+
+		// 唤醒阻塞在run中的线程，可以在任意线程调用
+		void wake()
+		{
+			io.wake();
+		}
+
+		resume_mode get_resume_mode() const
+		{
+			return resume;
+		}
+
+		size_t get_resume_budget() const
+		{
+			return resume_budget;
+		}
+
+		// cascade时budget为每次update接着恢复的最大数量，防止长依赖链占满一帧
+		void set_resume_mode(resume_mode _mode, size_t budget = std::numeric_limits<size_t>::max())
+		{
+			resume = _mode;
+			resume_budget = budget;
+
+			if (resume != resume_mode::cascade)
+				ready.splice(woken);
+		}
+
+		// 挂入时间轮
+		void add_timer(awaitable* _awaitable, uint64_t deadline)
+		{
+			if (mode == timer_mode::scan)
+			{
+				// 不挂入时间轮，与时间轮一样最早在下一个未处理的tick到期
+				_awaitable->unlink();
+				_awaitable->deadline = deadline < timers.get_current() ? timers.get_current() : deadline;
+			}
+			else
+			{
+				timers.schedule(_awaitable, deadline);
+			}
+
+			set_wait(_awaitable, coroutine_slot::wait_kind::timer, _awaitable->deadline);
+		}
+
+		timer_mode get_timer_mode() const
+		{
+			return mode;
+		}
+
+		// 切换定时等待的处理方式，切回时间轮时把扫描中的等待挂入时间轮
+		void set_timer_mode(timer_mode _mode)
+		{
+			if (mode == _mode)
+				return;
+
+			mode = _mode;
+
+			if (mode != timer_mode::wheel)
+				return;
+
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) != coroutine_slot::slot_state::suspended || slots.get_deadline(i) == slot_table::no_deadline)
+					continue;
+
+				awaitable* waiting = slots.get_handle(i).promise().awaitable_ptr;
+				if (waiting != nullptr && !waiting->is_linked())
+					timers.schedule(waiting, slots.get_deadline(i));
+			}
+		}
+
+		// 挂入轮询链表
+		void add_polling(awaitable* _awaitable)
+		{
+			polling.push_back(_awaitable);
+			set_wait(_awaitable, coroutine_slot::wait_kind::polling, slot_table::no_deadline);
+		}
+
+		// 挂入就绪队列，条件满足的awaitable可随时调用，下一次update时恢复
+		void add_ready(awaitable* _awaitable)
+		{
+			if (_awaitable->is_done())
+				return;
+
+			_awaitable->detach();
+			ready.push_back(_awaitable);
+			set_wait(_awaitable, coroutine_slot::wait_kind::ready, slot_table::no_deadline);
+		}
+
+		// 挂入event_id的等待表，超时由之前的add_timer设置
+		void add_event_waiter(int event_id, event_node* node)
+		{
+			event_waiters[event_id].push_back(node);
+			set_wait(node->owner, coroutine_slot::wait_kind::event, node->owner->deadline);
+		}
+
+#if defined COROUTINE_REACTOR
+		// 挂入reactor，没有超时的等待不参与轮询，只由reactor唤醒
+		int add_io_waiter(fd_node* node, bool timed)
+		{
+			int error = io.add(node);
+			if (error != 0)
+				return error;
+
+			if (!timed)
+				node->owner->unlink();
+
+			set_wait(node->owner, coroutine_slot::wait_kind::io, timed ? node->owner->deadline : slot_table::no_deadline);
+			return 0;
+		}
+
+		// 等待超时、被取消或销毁时从reactor摘除
+		void remove_io_waiter(fd_node* node)
+		{
+			io.remove(node);
+		}
+
+		// 没有关注中的fd，update时不需要轮询
+		bool io_idle() const
+		{
+			return io.empty();
+		}
+#endif
+
+		// 挂入同步原语的等待链表，只由同步原语唤醒，不需要轮询
+		void add_sync_waiter(coroutine_timer::intrusive_list& waiters, sync_node* node)
+		{
+			node->owner->unlink();
+			waiters.push_back(node);
+			set_wait(node->owner, coroutine_slot::wait_kind::sync, slot_table::no_deadline);
+		}
+
+		// 同步原语交出所有权或完成时唤醒等待者，cascade时在本次update中接着恢复
+		void wake_sync(awaitable* _awaitable)
+		{
+			if (resume == resume_mode::cascade)
+				add_woken(_awaitable);
+			else
+				add_ready(_awaitable);
+		}
+
+		// 挂入协程id的依赖链表，协程结束或被删除时通知
+		bool add_dependent(uint64_t id, dependent_node* node)
+		{
+			if (!exists_coroutine(id))
+				return false;
+
+			// 结束时由close_slot通知，不需要轮询
+			node->owner->unlink();
+			dependents[slot_table::index_of(id)].push_back(node);
+			set_wait(node->owner, coroutine_slot::wait_kind::coroutine, slot_table::no_deadline);
+
+			return true;
+		}
+
+		// 触发指定的事件，默认交给全部等待者，只能移动的值只交给最早挂起的等待者
+		// 值为指针时使用下面的重载
+		template<typename T, typename = std::enable_if_t<!std::is_pointer_v<std::decay_t<T>>>>
+		void trigger_event(int event_id, T&& value, delivery how = delivery::broadcast())
+		{
+			current_scope scope(this);
+
+			dispatch_events<std::decay_t<T>>(event_id, &value, 1, how, !std::is_lvalue_reference_v<T>);
+		}
+
+		// 复制ret_value指向的值，为空时等待者得到空值
+		template<typename T>
+		void trigger_event(int event_id, const T* ret_value, delivery how = delivery::broadcast())
+		{
+			current_scope scope(this);
+
+			if (ret_value != nullptr)
+			{
+				dispatch_events<T>(event_id, ret_value, 1, how, false);
+				return;
+			}
+
+			dispatch_waiters<T>(event_id, 1, how.consumers, [](wait_for_event<T>*, size_t, bool) { });
+		}
+
+		// 批量触发同一个事件，values依次交给触发前已挂起的等待者，每个值交给how.consumers个，
+		// 等待者只查找和遍历一次。只交给一个等待者的值会被移走
+		template<typename T>
+		void trigger_events(int event_id, T* values, size_t count, delivery how = delivery::one_shot())
+		{
+			current_scope scope(this);
+
+			dispatch_events<std::remove_const_t<T>>(event_id, values, count, how, true);
+		}
+
+		// 同一个值触发多个事件
+		template<typename T>
+		void trigger_events(const int* event_ids, size_t count, const T& value, delivery how = delivery::broadcast())
+		{
+			current_scope scope(this);
+
+			for (size_t i = 0; i < count; i++)
+				dispatch_events<T>(event_ids[i], &value, 1, how, false);
+		}
+
+		// 任意线程调用，把value放入收件箱，下一次update开始时触发，不阻塞，收件箱满时返回false
+		// 不超过event_payload::inline_size的值不分配内存
+		template<typename T, typename = std::enable_if_t<!std::is_pointer_v<std::decay_t<T>>>>
+		bool post_event(int event_id, T&& value, delivery how = delivery::broadcast())
+		{
+			typedef std::decay_t<T> value_type;
+
+			posted_event posted;
+			posted.event_id = event_id;
+			posted.how = how;
+			posted.payload.emplace<value_type>(std::forward<T>(value));
+			posted.handler = &deliver_posted<value_type>;
+
+			return push_posted(std::move(posted));
+		}
+
+		// 创建新协程，绑定到此管理器后开始执行
+		// token为空时继承正在运行的协程绑定的token
+		uint64_t create_coroutine(coroutine_t handler, priority _priority = priority::normal, const cancellation_token& token = cancellation_token())
+		{
+			if (handler.handle == nullptr || handler.handle.done())
+				return (uint64_t)0;
+
+			uint64_t id = slots.allocate(handler.handle);
+			if (id == 0)
+				return (uint64_t)0;
+
+			while (dependents.size() < slots.size())
+			{
+				dependents.emplace_back();
+				cancel_nodes.emplace_back();
+			}
+
+			handler.handle.promise().manager = this;
+			handler.handle.promise().id = id;
+
+			size_t index = slot_table::index_of(id);
+			slots.set_priority(index, _priority);
+			metrics.on_spawn(index);
+			bind_cancellation(index, id, token.valid() ? token : get_running_token());
+
+			current_scope scope(this);
+			running_scope running(this, id);
+
+			handler.handle.resume();
+
+			// 没有挂起就结束或运行中被删除的协程立即回收
+			if (handler.handle.done() || slots.has_flag(index, coroutine_slot::flag_destroy_pending))
+			{
+				release_coroutine(id);
+				return (uint64_t)0;
+			}
+
+			return id;
+		}
+
+		// 删除指定的协程，如果是当前协程，则此协程暂停后删除
+		bool destroy_coroutine(uint64_t id)
+		{
+			if (!slots.contains(id))
+				return false;
+
+			size_t index = slot_table::index_of(id);
+			if (slots.get_state(index) == coroutine_slot::slot_state::running)
+			{
+				slots.set_flag(index, coroutine_slot::flag_destroy_pending);
+				return true;
+			}
+
+			close_slot(index);
+
+			return true;
+		}
+
+		// 协作式取消，挂起的协程从等待结构中摘除后立即以取消状态恢复，
+		// 正在运行的协程在下一次挂起时放入就绪队列
+		bool cancel_coroutine(uint64_t id)
+		{
+			if (!slots.contains(id))
+				return false;
+
+			size_t index = slot_table::index_of(id);
+			if (slots.has_flag(index, coroutine_slot::flag_cancelled))
+				return true;
+
+			slots.set_flag(index, coroutine_slot::flag_cancelled);
+
+			if (slots.get_state(index) != coroutine_slot::slot_state::suspended)
+				return true;
+
+			awaitable* waiting = slots.get_handle(index).promise().awaitable_ptr;
+			if (waiting != nullptr)
+			{
+				current_scope scope(this);
+
+				waiting->mark_cancelled();
+				resume_awaitable(waiting);
+			}
+
+			return true;
+		}
+
+		// 正在运行的协程id，不在协程中时为0
+		uint64_t get_running_coroutine() const
+		{
+			return running_id;
+		}
+
+		bool is_cancelled(uint64_t id) const
+		{
+			return slots.contains(id) && slots.has_flag(slot_table::index_of(id), coroutine_slot::flag_cancelled);
+		}
+
+		// 协程绑定的取消标记，没有绑定时为空
+		cancellation_token get_cancellation_token(uint64_t id) const
+		{
+			if (!slots.contains(id))
+				return cancellation_token();
+
+			return cancellation_token(cancel_nodes[slot_table::index_of(id)].state);
+		}
+
+		// 统计快照，未定义COROUTINE_METRICS时只有槽位数量有效
+		manager_stats get_stats() const
+		{
+			manager_stats stats;
+			stats.live_coroutines = slots.live_count();
+			stats.free_slots = slots.free_count();
+			stats.ticks_per_second = ticks_per_second;
+			metrics.fill(stats);
+
+			return stats;
+		}
+
+		// 协程的统计，协程不存在或未定义COROUTINE_METRICS时返回false
+		bool get_coroutine_stats(uint64_t id, coroutine_stats& stats) const
+		{
+			if (!slots.contains(id))
+				return false;
+
+			return metrics.get(slot_table::index_of(id), cur_tick, stats);
+		}
 
-				awaitable* _awaitable = coroutines[i].handle.promise().awaitable_ptr;
-				if (_awaitable == nullptr)
+		// 对每个存在的协程调用f(id, stats)，未定义COROUTINE_METRICS时不会调用
+		template<typename F>
+		void for_each_coroutine_stats(F&& f) const
+		{
+			coroutine_stats stats;
+
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) == coroutine_slot::slot_state::free)
 					continue;
 
-				if (_awaitable->can_resume())
-					_awaitable->resume();
+				if (metrics.get(i, cur_tick, stats))
+					f(slots.get_handle(i).promise().id, stats);
 			}
 		}
 
-		// 触发指定的事件
-		template<typename T>
-		void trigger_event(int event_id, const T* ret_value)
+		// 协程句柄，不存在时返回空
+		coroutine_t::handle_type get_coroutine(uint64_t id) const
+		{
+			if (!slots.contains(id))
+				return nullptr;
+
+			return slots.get_handle(slot_table::index_of(id));
+		}
+
+		// 只检查槽位表，不访问协程帧
+		bool exists_coroutine(uint64_t id) const
+		{
+			return slots.contains(id);
+		}
+
+		// 修改优先级，已在运行队列中的等待下一次入队时生效
+		bool set_priority(uint64_t id, priority _priority)
+		{
+			if (!slots.contains(id))
+				return false;
+
+			slots.set_priority(slot_table::index_of(id), _priority);
+			return true;
+		}
+
+		priority get_priority(uint64_t id) const
+		{
+			return slots.contains(id) ? slots.get_priority(slot_table::index_of(id)) : priority::normal;
+		}
+
+	private:
+		typedef coroutine_slot::slot_table<coroutine_t::handle_type> slot_table;
+
+		// 在作用域内把当前线程的管理器设为manager
+		struct current_scope
 		{
-			for (size_t i = 0; i < coroutines.size(); i++)
+			current_scope(coroutine_manager* manager) : previous(current)
 			{
-				if (coroutines[i].is_done())
-					continue;
+				current = manager;
+			}
 
-				wait_for_event<T>* _awaitable = dynamic_cast<wait_for_event<T>*>(coroutines[i].handle.promise().awaitable_ptr);
-				if (_awaitable == nullptr)
-					continue;
+			~current_scope()
+			{
+				current = previous;
+			}
 
-				if (_awaitable->get_event_id() != event_id)
-					continue;
+			coroutine_manager* previous;
+		};
 
-				if (_awaitable->is_done())
-					continue;
+		// 在作用域内记录正在运行的协程id，create_coroutine据此继承取消标记
+		struct running_scope
+		{
+			running_scope(coroutine_manager* _manager, uint64_t id) : manager(_manager), previous(_manager->running_id)
+			{
+				manager->running_id = id;
+				manager->metrics.begin_run(slot_table::index_of(id));
+			}
 
-				_awaitable->set_return_value(ret_value);
-				_awaitable->resume();
+			~running_scope()
+			{
+				manager->running_id = previous;
+				manager->metrics.end_run(previous != 0 ? slot_table::index_of(previous) : coroutine_metrics::no_index);
 			}
+
+			coroutine_manager* manager;
+			uint64_t previous;
+		};
+
+		cancellation_token get_running_token() const
+		{
+			return get_cancellation_token(running_id);
 		}
 
-		// 创建新协程
-		uint64_t create_coroutine(coroutine_t handler)
+		// 绑定取消标记，标记已取消时协程在第一次挂起时以取消状态恢复
+		void bind_cancellation(size_t index, uint64_t id, const cancellation_token& token)
 		{
-			if (handler.is_done())
-				return (uint64_t)0;
+			coroutine_cancel::cancel_node& node = cancel_nodes[index];
+			node.manager = this;
+			node.id = id;
+			node.cancel = &cancel_bound;
+
+			if (!token.bind(node))
+				slots.set_flag(index, coroutine_slot::flag_cancelled);
+		}
+
+		static void cancel_bound(void* manager, uint64_t id)
+		{
+			static_cast<coroutine_manager*>(manager)->cancel_coroutine(id);
+		}
+
+		// 恢复挂起在_awaitable上的协程，结束的协程立即回收
+		void resume_awaitable(awaitable* _awaitable)
+		{
+			_awaitable->detach();
+
+			coroutine_t::handle_type handle = _awaitable->get_handle();
+			if (handle == nullptr || handle.done())
+				return;
+
+			uint64_t id = handle.promise().id;
+			if (!slots.contains(id))
+				return;
+
+			size_t index = slot_table::index_of(id);
+			slots.set_state(index, coroutine_slot::slot_state::running);
+			metrics.on_resume(index, cur_tick);
 
-			size_t index;
-			if (free_indexes.size() > 0)
 			{
-				index = free_indexes.front();
-				free_indexes.pop();
+				running_scope running(this, id);
+				_awaitable->resume();
 			}
-			else
+
+			// 运行中被删除的协程挂起后在此回收
+			if (handle.done() || (slots.contains(id) && slots.has_flag(index, coroutine_slot::flag_destroy_pending)))
+				release_coroutine(id);
+		}
+
+		void release_coroutine(uint64_t id)
+		{
+			if (!slots.contains(id))
+				return;
+
+			close_slot(slot_table::index_of(id));
+		}
+
+		// 值依次交给触发前已挂起且类型相符的等待者，movable为true时交给最后一个等待者的值可以移走
+		template<typename T, typename Value>
+		void dispatch_events(int event_id, Value* values, size_t count, delivery how, bool movable)
+		{
+			size_t consumers = std::is_copy_constructible_v<T> ? how.consumers : 1;
+
+			dispatch_waiters<T>(event_id, count, consumers, [values, movable](wait_for_event<T>* waiter, size_t index, bool last)
 			{
-				index = coroutines.size();
-				coroutines.emplace_back(coroutine_t(handler));
-			}
+				if constexpr (!std::is_const_v<Value>)
+				{
+					if (movable && last)
+					{
+						waiter->set_value(std::move(values[index]));
+						return;
+					}
+				}
+
+				if constexpr (std::is_copy_constructible_v<T>)
+					waiter->set_value(values[index]);
+			});
+		}
+
+		// 只处理触发前已挂起的等待者，恢复过程中新挂入的等待下一次触发。
+		// 未交付的等待者保持先后顺序，排在新挂入的前面
+		template<typename T, typename Deliver>
+		void dispatch_waiters(int event_id, size_t count, size_t consumers, Deliver&& deliver)
+		{
+			auto it = event_waiters.find(event_id);
+			if (it == event_waiters.end())
+				return;
 
-			if (index > std::numeric_limits<unsigned int>::max())
+			coroutine_timer::intrusive_list& waiters = it->second;
+			coroutine_timer::intrusive_list pending;
+			coroutine_timer::intrusive_list skipped;
+			pending.splice(waiters);
+
+			++trigger_depth;
+
+			for (size_t i = 0; i < count && !pending.empty(); i++)
 			{
-				return (uint64_t)0;
+				size_t delivered = 0;
+				while (delivered < consumers && !pending.empty())
+				{
+					event_node* node = static_cast<event_node*>(pending.pop_front());
+
+					if (node->type != event_type<T>())
+					{
+						skipped.push_back(node);
+						continue;
+					}
+
+					wait_for_event<T>* _awaitable = static_cast<wait_for_event<T>*>(node->owner);
+					if (_awaitable->is_done())
+						continue;
+
+					++delivered;
+					deliver(_awaitable, i, delivered == consumers || pending.empty());
+					resume_awaitable(_awaitable);
+				}
 			}
 
-			++serial;
-			if (serial == 0)
-				serial = 1;
+			skipped.splice(pending);
+			skipped.splice(waiters);
+			waiters.splice(skipped);
 
-			uint64_t id = ((uint64_t)index << 32) | serial;
-			coroutines[index] = handler;
-			coroutines[index].id = id;
+			// 嵌套触发时外层还持有waiters的引用
+			if (--trigger_depth == 0 && waiters.empty())
+				event_waiters.erase(event_id);
+		}
 
-			return id;
+		// 其他线程投递的事件，值随posted_event一起移动
+		struct posted_event
+		{
+			int event_id{ 0 };
+			delivery how{ delivery::broadcast() };
+			coroutine_event::event_payload payload;
+			void (*handler)(coroutine_manager* manager, posted_event& posted){ nullptr };
+		};
+
+		template<typename T>
+		static void deliver_posted(coroutine_manager* manager, posted_event& posted)
+		{
+			manager->trigger_event(posted.event_id, std::move(*posted.payload.get<T>()), posted.how);
 		}
 
-		// 删除指定的协程，如果是当前协程，则此协程暂停后删除
-		bool destroy_coroutine(uint64_t id)
+#if defined COROUTINE_REACTOR
+		void poll_io(int timeout_ms)
 		{
-			unsigned int _index = (id >> 32);
+			if (io.empty())
+				return;
 
-			if (_index > coroutines.size())
-				return false;
+			io.poll(timeout_ms, &on_io_ready);
+		}
 
-			if (coroutines[_index].id != id)
-				return false;
+		static bool on_io_ready(coroutine_reactor::io_node* node)
+		{
+			return static_cast<fd_node*>(node)->owner->on_ready();
+		}
+#endif
 
-			if (coroutines[_index].is_done())
+		// 投递后run正在阻塞时唤醒
+		bool push_posted(posted_event&& posted)
+		{
+			if (!inbox.try_push(std::move(posted)))
 				return false;
 
-			coroutines[_index].close();
-
-			free_indexes.emplace(_index);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (sleeping.load(std::memory_order_relaxed))
+				io.wake();
 
 			return true;
 		}
 
-		const coroutine_t* get_coroutine(uint64_t id)
+		// 收件箱为空时阻塞，sleeping和投递之间的栅栏保证投递者能看到它并唤醒
+		void wait_idle(const std::chrono::steady_clock::time_point* deadline)
 		{
-			unsigned int _index = (id >> 32);
+			sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
 
-			if (_index > coroutines.size())
-				return nullptr;
+			if (inbox.empty() && !stopping.load(std::memory_order_relaxed))
+			{
+#if defined COROUTINE_REACTOR
+				io.wait(deadline, &on_io_ready);
+#else
+				io.wait(deadline);
+#endif
+			}
 
-			if (coroutines[_index].id != id)
-				return nullptr;
+			sleeping.store(false, std::memory_order_relaxed);
+		}
 
-			if (coroutines[_index].is_done())
-				return nullptr;
+		// 只处理不超过队列容量的数量，生产者持续投递时update也能返回
+		void drain_inbox()
+		{
+			posted_event posted;
+			for (size_t i = inbox.capacity(); i > 0 && inbox.try_pop(posted); i--)
+				posted.handler(this, posted);
+		}
+
+		// 扫描槽位表的deadline列，到期的定时等待放入运行队列
+		void enqueue_expired_slots(uint64_t tick)
+		{
+			expired_slots.clear();
+			coroutine_scan::scan_expired(slots.get_deadlines(), slots.size(), tick, expired_slots);
+
+			for (size_t i = 0; i < expired_slots.size(); i++)
+			{
+				size_t index = expired_slots[i];
+
+				// 前面恢复的协程可能已删除此协程或改变了它的等待
+				if (slots.get_state(index) != coroutine_slot::slot_state::suspended || slots.get_deadline(index) > tick)
+					continue;
+
+				awaitable* waiting = slots.get_handle(index).promise().awaitable_ptr;
+				if (waiting != nullptr)
+					enqueue(waiting);
+			}
+		}
+
+		// 记录awaitable所在协程的等待类型
+		void set_wait(awaitable* _awaitable, coroutine_slot::wait_kind kind, uint64_t deadline)
+		{
+			coroutine_t::handle_type handle = _awaitable->get_handle();
+			if (handle == nullptr)
+				return;
 
-			return &coroutines[_index];
+			uint64_t id = handle.promise().id;
+			if (!slots.contains(id))
+				return;
+
+			size_t index = slot_table::index_of(id);
+
+			// 已取消的协程不再等待，下一次update以取消状态恢复
+			if (kind != coroutine_slot::wait_kind::ready && slots.has_flag(index, coroutine_slot::flag_cancelled))
+			{
+				_awaitable->mark_cancelled();
+				add_ready(_awaitable);
+				return;
+			}
+
+			metrics.on_wait(index, kind, cur_tick);
+			slots.set_wait(index, kind, deadline);
+		}
+
+		// 按所在协程的优先级放入运行队列，由run_queues恢复
+		void enqueue(awaitable* _awaitable)
+		{
+			_awaitable->detach();
+
+			coroutine_t::handle_type handle = _awaitable->get_handle();
+			if (handle == nullptr || handle.done())
+				return;
+
+			uint64_t id = handle.promise().id;
+			if (!slots.contains(id))
+				return;
+
+			size_t index = slot_table::index_of(id);
+			metrics.on_wait(index, coroutine_slot::wait_kind::ready, cur_tick);
+			queues[(size_t)slots.get_priority(index)].push_back(_awaitable);
+			slots.set_wait(index, coroutine_slot::wait_kind::ready, slot_table::no_deadline);
+		}
+
+		// 记录本次update已恢复的数量和用时，时间每check_interval次检查一次
+		class budget_meter
+		{
+		public:
+			static constexpr size_t check_interval = 32;
+
+			explicit budget_meter(const update_budget& budget) : remaining(budget.resumes)
+			{
+				if (budget.time.count() > 0)
+				{
+					timed = true;
+					deadline = std::chrono::steady_clock::now() + budget.time;
+				}
+			}
+
+			// 预算未用完时计入一次恢复并返回true
+			bool take()
+			{
+				if (remaining == 0)
+					return false;
+
+				if (timed && ++counter % check_interval == 0 && std::chrono::steady_clock::now() >= deadline)
+				{
+					remaining = 0;
+					return false;
+				}
+
+				--remaining;
+				return true;
+			}
+
+		private:
+			size_t remaining;
+			size_t counter{ 0 };
+			bool timed{ false };
+			std::chrono::steady_clock::time_point deadline;
+		};
+
+		// 按优先级恢复运行队列，预算用完时返回false
+		bool run_queues(budget_meter& meter)
+		{
+			for (size_t i = 0; i < coroutine_slot::priority_count; i++)
+			{
+				while (!queues[i].empty())
+				{
+					if (!meter.take())
+						return false;
+
+					resume_awaitable(static_cast<awaitable*>(queues[i].pop_front()));
+				}
+			}
+
+			return true;
+		}
+
+		// 挂入本次update接着恢复的队列
+		void add_woken(awaitable* _awaitable)
+		{
+			if (_awaitable->is_done())
+				return;
+
+			_awaitable->detach();
+			woken.push_back(_awaitable);
+			set_wait(_awaitable, coroutine_slot::wait_kind::ready, slot_table::no_deadline);
 		}
 
-		bool exists_coroutine(uint64_t id)
+		// 关闭槽位上的协程，通知等待它的协程
+		void close_slot(size_t _index)
 		{
-			return get_coroutine(id) != nullptr;
+			coroutine_timer::intrusive_list& waiters = dependents[_index];
+
+			while (!waiters.empty())
+			{
+				dependent_node* node = static_cast<dependent_node*>(waiters.pop_front());
+
+				if (node->remaining != nullptr && --(*node->remaining) > 0)
+					continue;
+
+				if (resume == resume_mode::cascade)
+					add_woken(node->owner);
+				else
+					add_ready(node->owner);
+			}
+
+			coroutine_cancel::unbind(cancel_nodes[_index]);
+
+			// 先释放槽位，协程帧析构过程中此id已无效
+			coroutine_t::handle_type handle = slots.get_handle(_index);
+			slots.release(_index);
+
+			if (handle != nullptr)
+				handle.destroy();
 		}
 
 	private:
-		std::vector< coroutine_t> coroutines;
-		std::queue< size_t> free_indexes;
+		slot_table slots;
 
-		unsigned int serial{ 0 };
 		uint64_t cur_tick;
+		uint64_t ticks_per_second;
+		timer_mode mode{ timer_mode::wheel };
+		resume_mode resume{ resume_mode::next_update };
+		size_t resume_budget{ std::numeric_limits<size_t>::max() };
+		// 其他线程投递的事件
+		coroutine_inbox::mpsc_queue<posted_event> inbox;
+		// resume_expired_slots的临时数组
+		std::vector<uint32_t> expired_slots;
+
+		// 定时等待
+		coroutine_timer::timer_wheel timers;
+		// 需要轮询的等待
+		coroutine_timer::intrusive_list polling;
+		// 等待下一次update恢复
+		coroutine_timer::intrusive_list ready;
+		// cascade时在本次update中接着恢复
+		coroutine_timer::intrusive_list woken;
+		// 按优先级排队等待恢复，超出预算的留到下一次update
+		coroutine_timer::intrusive_list queues[coroutine_slot::priority_count];
+		// 每个槽位上等待该协程结束的依赖节点
+		std::deque<coroutine_timer::intrusive_list> dependents;
+		// 每个槽位与取消标记的绑定
+		std::deque<coroutine_cancel::cancel_node> cancel_nodes;
+		// fd就绪通知，run空闲时在此阻塞
+		coroutine_reactor::reactor io;
+		std::atomic<bool> sleeping{ false };
+		std::atomic<bool> stopping{ false };
+		// 正在运行的协程，不在协程中时为0
+		uint64_t running_id{ 0 };
+		// 定义COROUTINE_METRICS时的运行统计，否则为空
+		coroutine_metrics::recorder metrics;
+		// 按event_id索引的事件等待表
+		std::unordered_map<int, coroutine_timer::intrusive_list> event_waiters;
+		unsigned int trigger_depth{ 0 };
+
+		static inline thread_local coroutine_manager* current{ nullptr };
 	};
 
 	inline uint64_t get_cur_tick()
 	{
-		return coroutine_manager::instance->get_tick();
+		return coroutine_manager::get_current()->get_tick();
+	}
+
+	inline void awaitable::on_suspend(awaiting_handle _awaiting_handle)
+	{
+		handle = _awaiting_handle.root;
+		frame = _awaiting_handle.frame;
+		cancelled = false;
+		handle.promise().set_awaitable(this);
+
+		manager = handle.promise().manager;
+		manager->add_polling(this);
+	}
+
+	inline bool check_cancelled::await_resume()
+	{
+		coroutine_manager* manager = coroutine_manager::get_current();
+
+		return manager != nullptr && manager->is_cancelled(manager->get_running_coroutine());
+	}
+
+	inline uint64_t awaitable::get_tick() const
+	{
+		return manager->get_tick();
+	}
+
+	inline float awaitable::get_elapsed_seconds(uint64_t since) const
+	{
+		return (float)(manager->get_tick() - since) / (float)manager->get_ticks_per_second();
+	}
+
+	inline void awaitable::wait_until(uint64_t deadline)
+	{
+		manager->add_timer(this, deadline);
+	}
+
+	inline void awaitable::wait_for(duration_t timeout)
+	{
+		manager->add_timer(this, manager->get_deadline(timeout));
+	}
+
+	inline void awaitable::wait_ready()
+	{
+		manager->add_ready(this);
+	}
+
+	inline bool awaitable::wait_coroutine(uint64_t id, dependent_node* node)
+	{
+		return manager->add_dependent(id, node);
+	}
+
+	inline void awaitable::wait_event(int event_id, event_node* node)
+	{
+		manager->add_event_waiter(event_id, node);
+	}
+
+#if defined COROUTINE_REACTOR
+	inline int awaitable::wait_io(fd_node* node, bool timed)
+	{
+		return manager->add_io_waiter(node, timed);
 	}
 
+	inline void awaitable::leave_io(fd_node* node)
+	{
+		manager->remove_io_waiter(node);
+	}
+#endif
+
 	inline bool wait_for_coroutine::can_resume()
 	{
-		return !coroutine_manager::instance->exists_coroutine(wait_coroutine_id);
+		return !manager->exists_coroutine(wait_coroutine_id);
 	}
 
 	inline bool wait_for_coroutine_group::can_resume()
 	{
 		for (size_t i = 0; i < count; i++)
 		{
-			if (coroutine_manager::instance->exists_coroutine(wait_coroutine_groups[i]))
+			if (manager->exists_coroutine(wait_coroutine_groups[i]))
 				return false;
 		}
 
 		return true;
 	}
+
+	inline void sync_awaitable::grant()
+	{
+		granted = true;
+		manager->wake_sync(this);
+	}
+
+	inline void sync_awaitable::grant_all(coroutine_timer::intrusive_list& waiters)
+	{
+		// 唤醒过程中不会有新的等待者挂入，先取出全部再唤醒
+		coroutine_timer::intrusive_list pending;
+		pending.splice(waiters);
+
+		while (!pending.empty())
+			static_cast<sync_node*>(pending.pop_front())->owner->grant();
+	}
+
+	inline void sync_awaitable::wait_sync(coroutine_timer::intrusive_list& waiters)
+	{
+		waiter.owner = this;
+		manager->add_sync_waiter(waiters, &waiter);
+	}
+
+	inline wait_for_mutex::~wait_for_mutex()
+	{
+		if (granted && !resumed)
+			mutex->unlock();
+	}
+
+	inline bool wait_for_mutex::await_ready()
+	{
+		granted = mutex->try_lock();
+		return granted;
+	}
+
+	inline void wait_for_mutex::await_suspend(awaiting_handle _awaiting_handle)
+	{
+		awaitable::on_suspend(_awaiting_handle);
+		sync_awaitable::wait_sync(mutex->waiters);
+	}
+
+	inline wait_for_semaphore::~wait_for_semaphore()
+	{
+		if (granted && !resumed)
+			semaphore->release();
+	}
+
+	inline bool wait_for_semaphore::await_ready()
+	{
+		granted = semaphore->try_acquire();
+		return granted;
+	}
+
+	inline void wait_for_semaphore::await_suspend(awaiting_handle _awaiting_handle)
+	{
+		awaitable::on_suspend(_awaiting_handle);
+		sync_awaitable::wait_sync(semaphore->waiters);
+	}
+
+	inline bool wait_for_latch::await_ready()
+	{
+		granted = latch->try_wait();
+		return granted;
+	}
+
+	inline void wait_for_latch::await_suspend(awaiting_handle _awaiting_handle)
+	{
+		awaitable::on_suspend(_awaiting_handle);
+		sync_awaitable::wait_sync(latch->waiters);
+	}
+
+	inline bool wait_for_barrier::await_ready()
+	{
+		granted = barrier->phase != phase;
+		return granted;
+	}
+
+	inline void wait_for_barrier::await_suspend(awaiting_handle _awaiting_handle)
+	{
+		awaitable::on_suspend(_awaiting_handle);
+		sync_awaitable::wait_sync(barrier->waiters);
+	}
 }
\ No newline at end of file
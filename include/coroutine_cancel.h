@@ -0,0 +1,114 @@
+﻿#pragma once
+/*
+	协作式取消
+	cancellation_source取消时，绑定了它的token的协程都被取消：挂起中的协程从等待结构中摘除后
+	立即以取消状态恢复，正在运行的协程在下一次挂起时恢复。只能在协程管理器所在的线程调用
+*/
+
+#include <stdint.h>
+#include <memory>
+
+#include "coroutine_timer.h"
+
+namespace coroutine_cancel
+{
+	struct cancellation_state;
+
+	// 协程和取消标记的绑定，由协程管理器按槽位保存
+	struct cancel_node : public coroutine_timer::list_node
+	{
+		void* manager{ nullptr };
+		uint64_t id{ 0 };
+		void (*cancel)(void* manager, uint64_t id){ nullptr };
+		// 绑定期间保持标记有效
+		std::shared_ptr<cancellation_state> state;
+	};
+
+	struct cancellation_state
+	{
+		bool cancelled{ false };
+		// 绑定的协程
+		coroutine_timer::intrusive_list bound;
+	};
+
+	// 取消标记，可以复制，绑定到协程后随source一起取消
+	class cancellation_token
+	{
+	public:
+		cancellation_token() { }
+
+		explicit cancellation_token(std::shared_ptr<cancellation_state> _state) : state(std::move(_state))
+		{
+		}
+
+		// 没有对应的source时永远不会取消
+		bool valid() const
+		{
+			return state != nullptr;
+		}
+
+		bool is_cancelled() const
+		{
+			return state != nullptr && state->cancelled;
+		}
+
+		// 绑定协程，已取消时返回false，由调用者立即取消协程
+		bool bind(cancel_node& node) const
+		{
+			node.unlink();
+			node.state = state;
+
+			if (state == nullptr)
+				return true;
+
+			state->bound.push_back(&node);
+			return !state->cancelled;
+		}
+
+	private:
+		std::shared_ptr<cancellation_state> state;
+	};
+
+	class cancellation_source
+	{
+	public:
+		cancellation_source() : state(std::make_shared<cancellation_state>())
+		{
+		}
+
+		cancellation_token get_token() const
+		{
+			return cancellation_token(state);
+		}
+
+		bool is_cancelled() const
+		{
+			return state->cancelled;
+		}
+
+		// 取消全部绑定的协程，取消过程中新绑定的协程同样被取消
+		void cancel()
+		{
+			state->cancelled = true;
+
+			// 恢复的协程可能销毁source
+			std::shared_ptr<cancellation_state> holder = state;
+
+			while (!holder->bound.empty())
+			{
+				cancel_node* node = static_cast<cancel_node*>(holder->bound.pop_front());
+				node->cancel(node->manager, node->id);
+			}
+		}
+
+	private:
+		std::shared_ptr<cancellation_state> state;
+	};
+
+	// 解除协程的绑定
+	inline void unbind(cancel_node& node)
+	{
+		node.unlink();
+		node.state.reset();
+	}
+}
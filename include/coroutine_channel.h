@@ -0,0 +1,118 @@
+﻿#pragma once
+/*
+	通道的缓冲
+	固定容量的环形缓冲，构造时一次分配全部格子，收发时只在格子内构造和析构值，不再分配内存。
+	只有退回的值放回头部时可以超出容量，此时格子不够才重新分配。
+	只在协程管理器所在的线程使用，跨线程投递仍然使用post_event
+*/
+
+#include <stddef.h>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <assert.h>
+
+namespace coroutine_channel
+{
+	template<typename T>
+	class ring_buffer
+	{
+	public:
+		// 容量可以为0，此时始终为满，值不经过缓冲
+		explicit ring_buffer(size_t _capacity) : cells(new std::optional<T>[_capacity]), slots(_capacity), limit(_capacity)
+		{
+		}
+
+		ring_buffer(const ring_buffer&) = delete;
+		ring_buffer& operator=(const ring_buffer&) = delete;
+
+		size_t capacity() const
+		{
+			return limit;
+		}
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return count == 0;
+		}
+
+		bool full() const
+		{
+			return count >= limit;
+		}
+
+		template<typename U>
+		void push(U&& value)
+		{
+			assert(!full());
+
+			size_t tail = head + count;
+			if (tail >= slots)
+				tail -= slots;
+
+			cells[tail].emplace(std::forward<U>(value));
+			++count;
+		}
+
+		// 放回头部，下一次pop最先取出，不受容量限制
+		template<typename U>
+		void push_front(U&& value)
+		{
+			if (count == slots)
+				grow();
+
+			head = head == 0 ? slots - 1 : head - 1;
+			cells[head].emplace(std::forward<U>(value));
+			++count;
+		}
+
+		// 取出最早放入的值
+		T pop()
+		{
+			assert(!empty());
+
+			std::optional<T>& cell = cells[head];
+			T value(std::move(*cell));
+			cell.reset();
+
+			if (++head == slots)
+				head = 0;
+
+			--count;
+			return value;
+		}
+
+	private:
+		// 格子数翻倍，值按顺序移到从0开始的位置
+		void grow()
+		{
+			size_t new_slots = slots > 0 ? slots * 2 : 1;
+			std::unique_ptr<std::optional<T>[]> new_cells(new std::optional<T>[new_slots]);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t index = head + i;
+				if (index >= slots)
+					index -= slots;
+
+				new_cells[i] = std::move(cells[index]);
+			}
+
+			cells = std::move(new_cells);
+			slots = new_slots;
+			head = 0;
+		}
+
+		std::unique_ptr<std::optional<T>[]> cells;
+		// 已分配的格子数，只在放回头部时超过limit
+		size_t slots;
+		size_t limit;
+		size_t head{ 0 };
+		size_t count{ 0 };
+	};
+}
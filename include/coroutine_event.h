@@ -0,0 +1,253 @@
+﻿#pragma once
+/*
+	事件值
+	事件按值携带返回值，只能移动，值可复制时用clone复制。不超过inline_size且可无异常移动的类型
+	直接存放在对象内，不分配内存，更大的类型才分配在堆上
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+namespace coroutine_event
+{
+	// 类型标记，代替typeid和dynamic_cast
+	template<typename T>
+	inline const void* type_tag()
+	{
+		static const char tag = 0;
+		return &tag;
+	}
+
+	// 一次触发交给几个等待者，都按挂起的先后顺序
+	struct delivery
+	{
+		size_t consumers;
+
+		// 交给全部等待者
+		static constexpr delivery broadcast()
+		{
+			return delivery{ SIZE_MAX };
+		}
+
+		// 只交给最早挂起的等待者
+		static constexpr delivery one_shot()
+		{
+			return delivery{ 1 };
+		}
+
+		// 交给最早挂起的count个等待者
+		static constexpr delivery first(size_t count)
+		{
+			return delivery{ count };
+		}
+	};
+
+	class event_payload
+	{
+	public:
+		static constexpr size_t inline_size = 64;
+
+		template<typename T>
+		static constexpr bool fits_inline = sizeof(T) <= inline_size && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<T>;
+
+	public:
+		event_payload() { }
+
+		template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, event_payload>>>
+		event_payload(T&& value)
+		{
+			emplace<std::decay_t<T>>(std::forward<T>(value));
+		}
+
+		event_payload(event_payload&& other) noexcept
+		{
+			move_from(other);
+		}
+
+		event_payload& operator=(event_payload&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				move_from(other);
+			}
+
+			return *this;
+		}
+
+		event_payload(const event_payload&) = delete;
+		event_payload& operator=(const event_payload&) = delete;
+
+		~event_payload()
+		{
+			reset();
+		}
+
+		template<typename T, typename... Args>
+		T& emplace(Args&&... args)
+		{
+			reset();
+
+			T* value;
+			if constexpr (fits_inline<T>)
+			{
+				value = new (storage) T(std::forward<Args>(args)...);
+			}
+			else
+			{
+				value = new T(std::forward<Args>(args)...);
+				heap = value;
+			}
+
+			ops = &operations_of<T>::value;
+
+			return *value;
+		}
+
+		bool has_value() const
+		{
+			return ops != nullptr;
+		}
+
+		// 值的类型标记，没有值时为空
+		const void* type() const
+		{
+			return ops != nullptr ? ops->type() : nullptr;
+		}
+
+		// 值可以复制，没有值时为false
+		bool copyable() const
+		{
+			return ops != nullptr && ops->copy != nullptr;
+		}
+
+		// 复制一份值，值不可复制时返回空的event_payload
+		event_payload clone() const
+		{
+			event_payload payload;
+			if (copyable())
+			{
+				ops->copy(payload, *this);
+				payload.ops = ops;
+			}
+
+			return payload;
+		}
+
+		template<typename T>
+		bool holds() const
+		{
+			return type() == type_tag<T>();
+		}
+
+		// 类型不符时返回空
+		template<typename T>
+		T* get()
+		{
+			return holds<T>() ? static_cast<T*>(data()) : nullptr;
+		}
+
+		void* data()
+		{
+			if (ops == nullptr)
+				return nullptr;
+
+			return ops->inline_value ? (void*)storage : heap;
+		}
+
+		const void* data() const
+		{
+			return const_cast<event_payload*>(this)->data();
+		}
+
+		void reset()
+		{
+			if (ops != nullptr)
+			{
+				ops->destroy(*this);
+				ops = nullptr;
+			}
+		}
+
+	private:
+		struct operations
+		{
+			const void* (*type)();
+			bool inline_value;
+			void (*move)(event_payload& to, event_payload& from);
+			// 值不可复制时为空
+			void (*copy)(event_payload& to, const event_payload& from);
+			void (*destroy)(event_payload& payload);
+		};
+
+		template<typename T>
+		struct operations_of
+		{
+			static void move(event_payload& to, event_payload& from)
+			{
+				if constexpr (fits_inline<T>)
+				{
+					T* value = reinterpret_cast<T*>(from.storage);
+					new (to.storage) T(std::move(*value));
+					value->~T();
+				}
+				else
+				{
+					to.heap = from.heap;
+					from.heap = nullptr;
+				}
+			}
+
+			static void copy(event_payload& to, const event_payload& from)
+			{
+				const T* value = static_cast<const T*>(from.data());
+
+				if constexpr (fits_inline<T>)
+					new (to.storage) T(*value);
+				else
+					to.heap = new T(*value);
+			}
+
+			static void destroy(event_payload& payload)
+			{
+				if constexpr (fits_inline<T>)
+					reinterpret_cast<T*>(payload.storage)->~T();
+				else
+					delete static_cast<T*>(payload.heap);
+			}
+
+			static constexpr void (*copy_function())(event_payload&, const event_payload&)
+			{
+				if constexpr (std::is_copy_constructible_v<T>)
+					return &copy;
+				else
+					return nullptr;
+			}
+
+			static constexpr operations value{ &type_tag<T>, fits_inline<T>, &move, copy_function(), &destroy };
+		};
+
+		void move_from(event_payload& other)
+		{
+			if (other.ops == nullptr)
+				return;
+
+			other.ops->move(*this, other);
+			ops = other.ops;
+			other.ops = nullptr;
+		}
+
+	private:
+		union
+		{
+			alignas(std::max_align_t) unsigned char storage[inline_size];
+			void* heap;
+		};
+
+		const operations* ops{ nullptr };
+	};
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+/*
+	跨线程投递队列
+	有界的多生产者单消费者环形队列，生产者之间用CAS争抢位置，不加锁也不阻塞，
+	队列满时投递失败由调用者决定重试或丢弃。每个格子的序号标记格子是否可写或可读
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace coroutine_inbox
+{
+	template<typename T>
+	class mpsc_queue
+	{
+	public:
+		static constexpr size_t default_capacity = 1024;
+
+	public:
+		// 容量向上取整到2的幂
+		explicit mpsc_queue(size_t capacity = default_capacity)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size <<= 1;
+
+			cells.reset(new cell[size]);
+			mask = size - 1;
+
+			for (size_t i = 0; i < size; i++)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		mpsc_queue(const mpsc_queue&) = delete;
+		mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+		size_t capacity() const
+		{
+			return mask + 1;
+		}
+
+		// 任意线程调用，队列满时返回false，此时value不会被移走
+		template<typename U>
+		bool try_push(U&& value)
+		{
+			size_t position = tail.load(std::memory_order_relaxed);
+
+			while (true)
+			{
+				cell& target = cells[position & mask];
+				size_t sequence = target.sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+				if (difference == 0)
+				{
+					if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						target.value = std::forward<U>(value);
+						target.sequence.store(position + 1, std::memory_order_release);
+
+						return true;
+					}
+				}
+				else if (difference < 0)
+				{
+					return false;
+				}
+				else
+				{
+					position = tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// 只能由消费者线程调用，队列为空时返回false
+		bool try_pop(T& value)
+		{
+			cell& target = cells[head & mask];
+			size_t sequence = target.sequence.load(std::memory_order_acquire);
+
+			if ((intptr_t)sequence - (intptr_t)(head + 1) < 0)
+				return false;
+
+			value = std::move(target.value);
+			target.sequence.store(head + mask + 1, std::memory_order_release);
+			++head;
+
+			return true;
+		}
+
+		// 只能由消费者线程调用，正在写入的值也算作非空
+		bool empty() const
+		{
+			return tail.load(std::memory_order_relaxed) == head;
+		}
+
+	private:
+		struct cell
+		{
+			std::atomic<size_t> sequence{ 0 };
+			T value{};
+		};
+
+		std::unique_ptr<cell[]> cells;
+		size_t mask{ 0 };
+
+		// 生产者和消费者的位置放在不同的缓存行
+		alignas(64) std::atomic<size_t> tail{ 0 };
+		alignas(64) size_t head{ 0 };
+	};
+}
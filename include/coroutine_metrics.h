@@ -0,0 +1,257 @@
+﻿#pragma once
+/*
+	运行统计
+	定义COROUTINE_METRICS时按槽位记录每个协程的恢复次数、运行的周期数(x86上为rdtsc，其余平台为steady_clock纳秒)
+	和按等待类型累计的挂起tick，以及管理器的创建数、恢复数和update耗时。
+	未定义时recorder的函数都为空，调用处不需要条件编译，get_stats只返回槽位的数量
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+#include "coroutine_slot.h"
+
+#if defined COROUTINE_METRICS
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+#include <intrin.h>
+#elif defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace coroutine_metrics
+{
+	// 单个协程的统计
+	struct coroutine_stats
+	{
+		// 不含创建时的首次运行
+		uint64_t resumes{ 0 };
+		// 只计自身运行的周期，其中创建并运行的子协程计入子协程
+		uint64_t running_cycles{ 0 };
+		// 按wait_kind累计的挂起tick，在就绪队列中等待恢复的时间计入ready
+		uint64_t suspended_ticks[coroutine_slot::wait_kind_count]{};
+	};
+
+	// 管理器的统计快照，计数都从管理器创建时累计，两次快照相减得到区间内的值
+	struct manager_stats
+	{
+		// 是否定义了COROUTINE_METRICS，否则只有槽位数量有效
+		bool enabled{ false };
+		size_t live_coroutines{ 0 };
+		size_t free_slots{ 0 };
+		uint64_t spawns{ 0 };
+		uint64_t resumes{ 0 };
+		uint64_t updates{ 0 };
+		// 最近一次update恢复的协程数和耗时
+		uint64_t last_update_resumes{ 0 };
+		uint64_t last_update_cycles{ 0 };
+		uint64_t max_update_cycles{ 0 };
+		uint64_t total_update_cycles{ 0 };
+		uint64_t ticks_per_second{ 0 };
+		// 管理器创建后经过的时间，和按此估算的每秒周期数
+		double elapsed_seconds{ 0.0 };
+		double cycles_per_second{ 0.0 };
+
+		double spawns_per_second() const
+		{
+			return elapsed_seconds > 0.0 ? (double)spawns / elapsed_seconds : 0.0;
+		}
+
+		double resumes_per_update() const
+		{
+			return updates > 0 ? (double)resumes / (double)updates : 0.0;
+		}
+
+		double cycles_to_seconds(uint64_t cycles) const
+		{
+			return cycles_per_second > 0.0 ? (double)cycles / cycles_per_second : 0.0;
+		}
+
+		double ticks_to_seconds(uint64_t ticks) const
+		{
+			return ticks_per_second > 0 ? (double)ticks / (double)ticks_per_second : 0.0;
+		}
+	};
+
+	static constexpr size_t no_index = SIZE_MAX;
+
+#if defined COROUTINE_METRICS
+	inline uint64_t read_cycles()
+	{
+#if (defined _MSC_VER && (defined _M_X64 || defined _M_IX86)) || defined __x86_64__ || defined __i386__
+		return (uint64_t)__rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// 由协程管理器在调度的各个位置调用，只能在管理器所在的线程使用
+	class recorder
+	{
+	public:
+		recorder() : start_time(std::chrono::steady_clock::now()), start_cycles(read_cycles())
+		{
+		}
+
+		// 槽位分配给新协程，清空上一个协程的统计
+		void on_spawn(size_t index)
+		{
+			if (records.size() <= index)
+				records.resize(index + 1);
+
+			records[index] = record();
+			++spawns;
+		}
+
+		// 挂起或改变等待类型，之前的挂起时间计入之前的类型
+		void on_wait(size_t index, coroutine_slot::wait_kind kind, uint64_t tick)
+		{
+			record& target = records[index];
+			if (target.suspended)
+				target.stats.suspended_ticks[(size_t)target.kind] += tick - target.since;
+
+			target.suspended = true;
+			target.kind = kind;
+			target.since = tick;
+		}
+
+		void on_resume(size_t index, uint64_t tick)
+		{
+			record& target = records[index];
+			if (target.suspended)
+				target.stats.suspended_ticks[(size_t)target.kind] += tick - target.since;
+
+			target.suspended = false;
+			target.stats.resumes++;
+			++resumes;
+		}
+
+		// 开始运行index上的协程，正在运行的外层协程先结算
+		void begin_run(size_t index)
+		{
+			uint64_t now = read_cycles();
+			charge(now);
+
+			running = index;
+			run_start = now;
+		}
+
+		// 回到外层协程，没有时为no_index
+		void end_run(size_t previous)
+		{
+			uint64_t now = read_cycles();
+			charge(now);
+
+			running = previous;
+			run_start = now;
+		}
+
+		void begin_update()
+		{
+			update_start = read_cycles();
+			update_resumes = resumes;
+		}
+
+		void end_update()
+		{
+			uint64_t cycles = read_cycles() - update_start;
+
+			++updates;
+			last_update_resumes = resumes - update_resumes;
+			last_update_cycles = cycles;
+			total_update_cycles += cycles;
+			if (cycles > max_update_cycles)
+				max_update_cycles = cycles;
+		}
+
+		void fill(manager_stats& stats) const
+		{
+			stats.enabled = true;
+			stats.spawns = spawns;
+			stats.resumes = resumes;
+			stats.updates = updates;
+			stats.last_update_resumes = last_update_resumes;
+			stats.last_update_cycles = last_update_cycles;
+			stats.max_update_cycles = max_update_cycles;
+			stats.total_update_cycles = total_update_cycles;
+
+			stats.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+			if (stats.elapsed_seconds > 0.0)
+				stats.cycles_per_second = (double)(read_cycles() - start_cycles) / stats.elapsed_seconds;
+		}
+
+		// 协程正在挂起时包含到tick为止的挂起时间
+		bool get(size_t index, uint64_t tick, coroutine_stats& stats) const
+		{
+			if (index >= records.size())
+				return false;
+
+			const record& target = records[index];
+			stats = target.stats;
+
+			if (target.suspended)
+				stats.suspended_ticks[(size_t)target.kind] += tick - target.since;
+
+			if (index == running)
+				stats.running_cycles += read_cycles() - run_start;
+
+			return true;
+		}
+
+	private:
+		struct record
+		{
+			coroutine_stats stats;
+			coroutine_slot::wait_kind kind{ coroutine_slot::wait_kind::none };
+			bool suspended{ false };
+			// 进入当前等待类型的tick
+			uint64_t since{ 0 };
+		};
+
+		void charge(uint64_t now)
+		{
+			if (running != no_index && running < records.size())
+				records[running].stats.running_cycles += now - run_start;
+		}
+
+		std::vector<record> records;
+		size_t running{ no_index };
+		uint64_t run_start{ 0 };
+
+		std::chrono::steady_clock::time_point start_time;
+		uint64_t start_cycles;
+
+		uint64_t spawns{ 0 };
+		uint64_t resumes{ 0 };
+		uint64_t updates{ 0 };
+		uint64_t update_start{ 0 };
+		uint64_t update_resumes{ 0 };
+		uint64_t last_update_resumes{ 0 };
+		uint64_t last_update_cycles{ 0 };
+		uint64_t max_update_cycles{ 0 };
+		uint64_t total_update_cycles{ 0 };
+	};
+#else
+	// 未开启统计，调用都被内联为空
+	class recorder
+	{
+	public:
+		void on_spawn(size_t) { }
+		void on_wait(size_t, coroutine_slot::wait_kind, uint64_t) { }
+		void on_resume(size_t, uint64_t) { }
+		void begin_run(size_t) { }
+		void end_run(size_t) { }
+		void begin_update() { }
+		void end_update() { }
+
+		void fill(manager_stats&) const { }
+
+		bool get(size_t, uint64_t, coroutine_stats&) const
+		{
+			return false;
+		}
+	};
+#endif
+}
@@ -0,0 +1,764 @@
+﻿#pragma once
+/*
+	多线程协程管理
+	每个工作线程拥有一个先进先出的就绪队列，空闲时从其他线程的队列尾部窃取，
+	协程可以在任意工作线程上恢复。create_coroutine、trigger_event、
+	destroy_coroutine和update可在任意线程调用。
+
+	扩展性的上限：wait_for_frame只经过本线程的就绪队列，其余的创建、结束、定时、
+	事件和依赖等待都要获取同一个wait_mutex，这部分吞吐不随工作线程数增加，
+	最多等于单线程持锁的速度。bench的parallel项给出1、2、4和硬件线程数个工作线程时的吞吐，
+	单核机器上两项都不随线程数变化，wait_for_frame每次约60ns，创建并结束一个协程约180ns(约550万次/秒)，
+	后者可作为多核时这些路径合计吞吐的近似上限。协程大多在等待定时或事件时，多个单线程管理器更合适
+
+	coroutine_t coroutine_func(...)
+	{
+		co_await wait_for_frame();
+	}
+*/
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <optional>
+#include <limits>
+#include <cmath>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <assert.h>
+
+#include "coroutine_std.h"
+#include "coroutine_timer.h"
+#include "coroutine_pool.h"
+#include "coroutine_slot.h"
+
+namespace coroutine_parallel
+{
+#if defined _WIN64
+	typedef unsigned long long uint64_t;
+#endif
+
+	class coroutine_manager;
+	class awaitable;
+
+	typedef coroutine_timer::duration_t duration_t;
+
+	// 事件返回值类型的标记，同一event_id下按类型区分等待者
+	template<typename T>
+	inline const void* event_type()
+	{
+		static const char tag = 0;
+		return &tag;
+	}
+
+	struct event_node : public coroutine_timer::list_node
+	{
+		awaitable* owner{ nullptr };
+		const void* type{ nullptr };
+	};
+
+	struct dependent_node : public coroutine_timer::list_node
+	{
+		awaitable* owner{ nullptr };
+	};
+
+	struct coroutine_t
+	{
+		// 内部属性
+		struct promise_type;
+		using handle_type = coroutine_std::coroutine_handle<promise_type>; //type alias
+
+		coroutine_t(handle_type h) :
+			handle(h)
+		{
+		}
+
+		// 协程结束时通知管理器，由管理器回收协程帧
+		struct final_awaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(handle_type _handle) noexcept;
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		struct promise_type
+		{
+			coroutine_manager* manager{ nullptr };
+			uint64_t id{ 0 };
+			// 挂起在时间轮、事件或依赖链表中的awaitable，由管理器加锁访问
+			awaitable* parked{ nullptr };
+			// destroy_coroutine请求，下次出队或挂起时销毁
+			std::atomic<bool> cancelled{ false };
+
+			promise_type() { }
+			~promise_type() { }
+
+#if !defined COROUTINE_NO_FRAME_POOL
+			static void* operator new(size_t size)
+			{
+				return coroutine_pool::frame_pool::allocate(size);
+			}
+
+			static void operator delete(void* ptr, size_t size)
+			{
+				coroutine_pool::frame_pool::deallocate(ptr, size);
+			}
+#endif
+
+			auto get_return_object()
+			{
+				return coroutine_t{ handle_type::from_promise(*this) };
+			}
+
+			auto initial_suspend() noexcept
+			{
+				// 由create_coroutine放入就绪队列后再在工作线程上执行
+				return coroutine_std::suspend_always{};
+			}
+
+			auto final_suspend() noexcept
+			{
+				return final_awaiter{};
+			}
+
+			void return_void()
+			{
+			}
+
+			void unhandled_exception()
+			{
+			}
+		};
+
+		// coroutine句柄
+		handle_type handle;
+	};
+
+	class awaitable : public coroutine_timer::timer_node
+	{
+	public:
+		virtual ~awaitable() { unlink(); }
+
+		// 唤醒前从所有等待结构中摘除
+		virtual void detach()
+		{
+			unlink();
+		}
+
+		bool await_ready()
+		{
+			return false;
+		}
+
+		coroutine_t::handle_type get_handle() const
+		{
+			return handle;
+		}
+
+	protected:
+		coroutine_t::handle_type handle;
+	};
+
+	// 让出当前工作线程，重新排队
+	class wait_for_frame : public awaitable
+	{
+	public:
+		void await_suspend(coroutine_t::handle_type _awaiting_handle);
+
+		void await_resume()
+		{
+		}
+	};
+
+	// 等待指定的时间，由update推进
+	class wait_for_seconds : public awaitable
+	{
+	public:
+		wait_for_seconds(float seconds) : timeout(coroutine_timer::seconds_to_duration(seconds))
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_seconds(const std::chrono::duration<Rep, Period>& _timeout) : timeout(coroutine_timer::to_duration(_timeout))
+		{
+		}
+
+		void await_suspend(coroutine_t::handle_type _awaiting_handle);
+
+		float await_resume();
+
+	private:
+		uint64_t start_tick{ 0 };
+		duration_t timeout;
+	};
+
+	// 等待指定的事件，超时返回空
+	template<typename T>
+	class wait_for_event : public awaitable
+	{
+	public:
+		wait_for_event(int _event_id, float _seconds) :
+			event_id(_event_id), timeout(coroutine_timer::seconds_to_duration(_seconds))
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_event(int _event_id, const std::chrono::duration<Rep, Period>& _timeout) :
+			event_id(_event_id), timeout(coroutine_timer::to_duration(_timeout))
+		{
+		}
+
+		void await_suspend(coroutine_t::handle_type _awaiting_handle);
+
+		std::optional<T> await_resume()
+		{
+			return std::move(value);
+		}
+
+		virtual void detach() override
+		{
+			awaitable::detach();
+			event_waiter.unlink();
+		}
+
+		void set_value(const T& _value)
+		{
+			value = _value;
+		}
+
+	private:
+		int event_id;
+		duration_t timeout;
+		std::optional<T> value;
+
+		event_node event_waiter;
+	};
+
+	// 等待指定的协程完成
+	class wait_for_coroutine : public awaitable
+	{
+	public:
+		wait_for_coroutine(uint64_t _id) : wait_coroutine_id(_id)
+		{
+		}
+
+		void await_suspend(coroutine_t::handle_type _awaiting_handle);
+
+		void await_resume()
+		{
+		}
+
+		virtual void detach() override
+		{
+			awaitable::detach();
+			waiter.unlink();
+		}
+
+	private:
+		uint64_t wait_coroutine_id;
+
+		dependent_node waiter;
+	};
+
+	class coroutine_manager
+	{
+	public:
+		// ticks_per_second为tick的精度，默认毫秒，可用微秒(1000000)或纳秒(1000000000)
+		coroutine_manager(uint64_t tick, uint64_t _ticks_per_second = coroutine_timer::default_ticks_per_second) :
+			cur_tick(tick), ticks_per_second(_ticks_per_second), timers(tick)
+		{
+			assert(ticks_per_second > 0 && ticks_per_second <= 1000000000);
+		}
+
+		coroutine_manager(const coroutine_manager&) = delete;
+		coroutine_manager& operator=(const coroutine_manager&) = delete;
+
+		~coroutine_manager()
+		{
+			stop();
+
+			// 剩余协程帧在此销毁，awaitable析构时自动从等待结构中摘除
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) != coroutine_slot::slot_state::free)
+				{
+					coroutine_t::handle_type handle = slots.get_handle(i);
+					slots.release(i);
+					handle.destroy();
+				}
+			}
+		}
+
+		// 启动工作线程，须在其他线程使用管理器之前调用
+		void start(size_t thread_count)
+		{
+			if (!workers.empty())
+				return;
+
+			if (thread_count == 0)
+				thread_count = 1;
+
+			running = true;
+
+			for (size_t i = 0; i < thread_count; i++)
+				workers.emplace_back(new worker());
+
+			// 启动前创建的协程
+			for (size_t i = 0; i < startup.size(); i++)
+				workers[i % thread_count]->ready.push_back(startup[i]);
+
+			queued.fetch_add(startup.size());
+			startup.clear();
+
+			for (size_t i = 0; i < thread_count; i++)
+				threads.emplace_back(&coroutine_manager::work, this, i);
+		}
+
+		// 停止并等待工作线程退出，未执行的协程保留到析构
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(idle_mutex);
+				running = false;
+			}
+
+			idle_cond.notify_all();
+
+			for (size_t i = 0; i < threads.size(); i++)
+				threads[i].join();
+
+			threads.clear();
+		}
+
+		uint64_t get_tick() const
+		{
+			return cur_tick.load(std::memory_order_relaxed);
+		}
+
+		uint64_t get_ticks_per_second() const
+		{
+			return ticks_per_second;
+		}
+
+		// 当前tick之后timeout的绝对deadline
+		uint64_t get_deadline(duration_t timeout) const
+		{
+			return coroutine_timer::add_ticks(get_tick(), coroutine_timer::duration_to_ticks(timeout, ticks_per_second));
+		}
+
+		// 推进时间，恢复到期的定时等待
+		void update(uint64_t tick)
+		{
+			cur_tick.store(tick, std::memory_order_relaxed);
+
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			coroutine_timer::intrusive_list expired;
+			timers.advance(tick, expired);
+
+			while (!expired.empty())
+				wake(static_cast<awaitable*>(expired.pop_front()));
+		}
+
+		// 触发指定的事件，value复制到每个等待者
+		template<typename T>
+		void trigger_event(int event_id, const T& value)
+		{
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			auto it = event_waiters.find(event_id);
+			if (it == event_waiters.end())
+				return;
+
+			coroutine_timer::intrusive_list& waiters = it->second;
+			coroutine_timer::intrusive_list pending;
+			pending.splice(waiters);
+
+			while (!pending.empty())
+			{
+				event_node* node = static_cast<event_node*>(pending.pop_front());
+
+				if (node->type != event_type<T>())
+				{
+					waiters.push_back(node);
+					continue;
+				}
+
+				static_cast<wait_for_event<T>*>(node->owner)->set_value(value);
+				wake(node->owner);
+			}
+
+			if (waiters.empty())
+				event_waiters.erase(it);
+		}
+
+		// 创建新协程，放入就绪队列
+		uint64_t create_coroutine(coroutine_t handler)
+		{
+			if (handler.handle == nullptr || handler.handle.done())
+				return (uint64_t)0;
+
+			uint64_t id;
+			{
+				std::lock_guard<std::mutex> lock(wait_mutex);
+
+				id = slots.allocate(handler.handle);
+				if (id == 0)
+					return (uint64_t)0;
+
+				while (dependents.size() < slots.size())
+					dependents.emplace_back();
+
+				handler.handle.promise().manager = this;
+				handler.handle.promise().id = id;
+			}
+
+			schedule(handler.handle);
+
+			return id;
+		}
+
+		// 删除指定的协程，挂起中的立即销毁，正在运行或排队的在下次出队或挂起时销毁
+		bool destroy_coroutine(uint64_t id)
+		{
+			coroutine_t::handle_type handle;
+			{
+				std::lock_guard<std::mutex> lock(wait_mutex);
+
+				if (!slots.contains(id))
+					return false;
+
+				size_t _index = slot_table::index_of(id);
+				handle = slots.get_handle(_index);
+
+				awaitable* parked = handle.promise().parked;
+				if (parked == nullptr)
+				{
+					handle.promise().cancelled.store(true, std::memory_order_release);
+					return true;
+				}
+
+				parked->detach();
+				handle.promise().parked = nullptr;
+
+				close_slot(_index);
+			}
+
+			handle.destroy();
+
+			return true;
+		}
+
+		bool exists_coroutine(uint64_t id)
+		{
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			return slots.contains(id);
+		}
+
+		// 已窃取的协程数量
+		uint64_t get_steal_count() const
+		{
+			return steals.load(std::memory_order_relaxed);
+		}
+
+	private:
+		friend struct coroutine_t::final_awaiter;
+		friend class wait_for_frame;
+		friend class wait_for_seconds;
+		template<typename T> friend class wait_for_event;
+		friend class wait_for_coroutine;
+
+		// 工作线程上的协程状态不在槽位表中记录，只用于id校验和句柄查找
+		typedef coroutine_slot::slot_table<coroutine_t::handle_type> slot_table;
+
+		struct worker
+		{
+			std::mutex mutex;
+			std::deque<coroutine_t::handle_type> ready;
+		};
+
+		void work(size_t index)
+		{
+			current_manager = this;
+			current_worker = index;
+
+			while (true)
+			{
+				coroutine_t::handle_type handle = nullptr;
+
+				if (pop_local(index, handle) || steal(index, handle))
+				{
+					run(handle);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(idle_mutex);
+				idle.fetch_add(1);
+				idle_cond.wait(lock, [this] { return !running || queued.load() > 0; });
+				idle.fetch_sub(1);
+
+				if (!running)
+					break;
+			}
+
+			current_manager = nullptr;
+		}
+
+		void run(coroutine_t::handle_type handle)
+		{
+			if (handle.promise().cancelled.load(std::memory_order_acquire))
+			{
+				discard(handle);
+				return;
+			}
+
+			// 恢复后协程可能已被其他线程接管，不再访问handle
+			handle.resume();
+		}
+
+		// 放入就绪队列，工作线程内放入本线程队列，其他线程轮流分配
+		void schedule(coroutine_t::handle_type handle)
+		{
+			if (workers.empty())
+			{
+				// 尚未启动，start时分配到各工作线程
+				startup.push_back(handle);
+				return;
+			}
+
+			size_t index;
+			if (current_manager == this)
+				index = current_worker;
+			else
+				index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+			{
+				std::lock_guard<std::mutex> lock(workers[index]->mutex);
+				workers[index]->ready.push_back(handle);
+			}
+
+			queued.fetch_add(1);
+
+			if (idle.load() > 0)
+			{
+				std::lock_guard<std::mutex> lock(idle_mutex);
+				idle_cond.notify_one();
+			}
+		}
+
+		bool pop_local(size_t index, coroutine_t::handle_type& handle)
+		{
+			worker& self = *workers[index];
+			std::lock_guard<std::mutex> lock(self.mutex);
+
+			if (self.ready.empty())
+				return false;
+
+			// 从头部按放入顺序取出，让出的协程排到已排队的协程之后
+			handle = self.ready.front();
+			self.ready.pop_front();
+			queued.fetch_sub(1);
+
+			return true;
+		}
+
+		bool steal(size_t index, coroutine_t::handle_type& handle)
+		{
+			for (size_t i = 1; i < workers.size(); i++)
+			{
+				worker& victim = *workers[(index + i) % workers.size()];
+
+				std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+				if (!lock.owns_lock() || victim.ready.empty())
+					continue;
+
+				handle = victim.ready.back();
+				victim.ready.pop_back();
+				queued.fetch_sub(1);
+				steals.fetch_add(1, std::memory_order_relaxed);
+
+				return true;
+			}
+
+			return false;
+		}
+
+		// 以下函数须持有wait_mutex
+
+		// 挂起到等待结构，已请求销毁的协程直接排队等待销毁
+		bool park(awaitable* _awaitable)
+		{
+			coroutine_t::handle_type handle = _awaitable->get_handle();
+
+			if (handle.promise().cancelled.load(std::memory_order_acquire))
+			{
+				schedule(handle);
+				return false;
+			}
+
+			handle.promise().parked = _awaitable;
+
+			return true;
+		}
+
+		void wake(awaitable* _awaitable)
+		{
+			coroutine_t::handle_type handle = _awaitable->get_handle();
+
+			_awaitable->detach();
+			handle.promise().parked = nullptr;
+
+			schedule(handle);
+		}
+
+		void close_slot(size_t _index)
+		{
+			coroutine_timer::intrusive_list& waiters = dependents[_index];
+
+			while (!waiters.empty())
+				wake(static_cast<dependent_node*>(waiters.pop_front())->owner);
+
+			slots.release(_index);
+		}
+
+		// 以上函数须持有wait_mutex
+
+		void suspend_timer(awaitable* _awaitable, uint64_t deadline)
+		{
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			if (park(_awaitable))
+				timers.schedule(_awaitable, deadline);
+		}
+
+		void suspend_event(awaitable* _awaitable, int event_id, event_node* node, uint64_t deadline)
+		{
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			if (park(_awaitable))
+			{
+				timers.schedule(_awaitable, deadline);
+				event_waiters[event_id].push_back(node);
+			}
+		}
+
+		void suspend_coroutine(awaitable* _awaitable, uint64_t id, dependent_node* node)
+		{
+			std::lock_guard<std::mutex> lock(wait_mutex);
+
+			if (!slots.contains(id))
+			{
+				schedule(_awaitable->get_handle());
+				return;
+			}
+
+			if (park(_awaitable))
+				dependents[slot_table::index_of(id)].push_back(node);
+		}
+
+		// 协程结束或被销毁，通知等待者并回收槽位
+		void discard(coroutine_t::handle_type handle)
+		{
+			{
+				std::lock_guard<std::mutex> lock(wait_mutex);
+
+				uint64_t id = handle.promise().id;
+				if (slots.contains(id))
+					close_slot(slot_table::index_of(id));
+			}
+
+			handle.destroy();
+		}
+
+	private:
+		std::atomic<uint64_t> cur_tick;
+		const uint64_t ticks_per_second;
+
+		// 槽位、时间轮、事件表和依赖链表由wait_mutex保护
+		std::mutex wait_mutex;
+		slot_table slots;
+		std::deque<coroutine_timer::intrusive_list> dependents;
+		coroutine_timer::timer_wheel timers;
+		std::unordered_map<int, coroutine_timer::intrusive_list> event_waiters;
+
+		std::vector<std::unique_ptr<worker>> workers;
+		std::vector<std::thread> threads;
+		std::atomic<size_t> next_worker{ 0 };
+		std::atomic<size_t> queued{ 0 };
+		std::atomic<uint64_t> steals{ 0 };
+
+		// 空闲的工作线程在此等待
+		std::mutex idle_mutex;
+		std::condition_variable idle_cond;
+		std::atomic<size_t> idle{ 0 };
+		bool running{ false };
+		// start之前创建的协程
+		std::vector<coroutine_t::handle_type> startup;
+
+		static inline thread_local coroutine_manager* current_manager{ nullptr };
+		static inline thread_local size_t current_worker{ 0 };
+	};
+
+	inline void coroutine_t::final_awaiter::await_suspend(handle_type _handle) noexcept
+	{
+		_handle.promise().manager->discard(_handle);
+	}
+
+	inline void wait_for_frame::await_suspend(coroutine_t::handle_type _awaiting_handle)
+	{
+		handle = _awaiting_handle;
+		handle.promise().manager->schedule(handle);
+	}
+
+	inline void wait_for_seconds::await_suspend(coroutine_t::handle_type _awaiting_handle)
+	{
+		handle = _awaiting_handle;
+
+		coroutine_manager* manager = handle.promise().manager;
+		start_tick = manager->get_tick();
+
+		manager->suspend_timer(this, manager->get_deadline(timeout));
+	}
+
+	inline float wait_for_seconds::await_resume()
+	{
+		coroutine_manager* manager = handle.promise().manager;
+
+		return (float)(manager->get_tick() - start_tick) / (float)manager->get_ticks_per_second();
+	}
+
+	template<typename T>
+	inline void wait_for_event<T>::await_suspend(coroutine_t::handle_type _awaiting_handle)
+	{
+		handle = _awaiting_handle;
+
+		coroutine_manager* manager = handle.promise().manager;
+
+		event_waiter.owner = this;
+		event_waiter.type = event_type<T>();
+
+		manager->suspend_event(this, event_id, &event_waiter, manager->get_deadline(timeout));
+	}
+
+	inline void wait_for_coroutine::await_suspend(coroutine_t::handle_type _awaiting_handle)
+	{
+		handle = _awaiting_handle;
+
+		waiter.owner = this;
+		handle.promise().manager->suspend_coroutine(this, wait_coroutine_id, &waiter);
+	}
+}
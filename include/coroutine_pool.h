@@ -0,0 +1,196 @@
+﻿#pragma once
+/*
+	协程帧内存池
+	按64字节分级，每个线程一组空闲链表，释放的帧优先被下一次创建复用，
+	可选预先提供一块固定内存(arena)，空闲链表为空时先从arena切分
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+
+namespace coroutine_pool
+{
+	// 当前线程的分配统计
+	struct pool_stats
+	{
+		// 从空闲链表取得
+		uint64_t hits{ 0 };
+		// 空闲链表为空，从arena或堆分配
+		uint64_t misses{ 0 };
+		// 超过分级上限，直接使用全局分配
+		uint64_t oversize{ 0 };
+		// 空闲链表已满，归还给堆
+		uint64_t releases{ 0 };
+		// 分配出去尚未归还的字节数(按分级大小)，帧在其他线程释放时可能为负
+		int64_t bytes_in_use{ 0 };
+	};
+
+	class frame_pool
+	{
+	public:
+		static constexpr size_t granularity = 64;
+		static constexpr size_t max_size = 4096;
+		static constexpr size_t class_count = max_size / granularity;
+		// 每个分级每个线程最多缓存的块数
+		static constexpr size_t cache_limit = 1024;
+
+	public:
+		static void* allocate(size_t size)
+		{
+			if (size == 0)
+				size = 1;
+
+			thread_cache& cache = local();
+
+			if (size > max_size)
+			{
+				++cache.stats.oversize;
+				cache.stats.bytes_in_use += (int64_t)size;
+				return ::operator new(size);
+			}
+
+			size_t index = (size - 1) / granularity;
+			size_t block_size = (index + 1) * granularity;
+
+			cache.stats.bytes_in_use += (int64_t)block_size;
+
+			free_block* block = cache.heads[index];
+			if (block != nullptr)
+			{
+				cache.heads[index] = block->next;
+				--cache.counts[index];
+				++cache.stats.hits;
+
+				return block;
+			}
+
+			++cache.stats.misses;
+
+			void* memory = arena_allocate(block_size);
+			if (memory != nullptr)
+				return memory;
+
+			return ::operator new(block_size);
+		}
+
+		static void deallocate(void* ptr, size_t size)
+		{
+			if (ptr == nullptr)
+				return;
+
+			if (size == 0)
+				size = 1;
+
+			thread_cache& cache = local();
+
+			if (size > max_size)
+			{
+				cache.stats.bytes_in_use -= (int64_t)size;
+				::operator delete(ptr);
+				return;
+			}
+
+			size_t index = (size - 1) / granularity;
+
+			cache.stats.bytes_in_use -= (int64_t)((index + 1) * granularity);
+
+			if (cache.counts[index] >= cache_limit && !in_arena(ptr))
+			{
+				++cache.stats.releases;
+				::operator delete(ptr);
+				return;
+			}
+
+			free_block* block = static_cast<free_block*>(ptr);
+			block->next = cache.heads[index];
+			cache.heads[index] = block;
+			++cache.counts[index];
+		}
+
+		// 设置固定内存，须在第一次分配前调用，memory的生命周期需覆盖所有协程
+		static bool set_arena(void* memory, size_t size)
+		{
+			if (arena_begin != nullptr || memory == nullptr)
+				return false;
+
+			// 按分级大小对齐，保证切分出的帧独占缓存行
+			uintptr_t begin = ((uintptr_t)memory + granularity - 1) & ~(uintptr_t)(granularity - 1);
+			uintptr_t end = (uintptr_t)memory + size;
+			if (begin >= end)
+				return false;
+
+			arena_size = (size_t)(end - begin);
+			arena_used.store(0, std::memory_order_relaxed);
+			arena_begin = (char*)begin;
+
+			return true;
+		}
+
+		static pool_stats get_stats()
+		{
+			return local().stats;
+		}
+
+	private:
+		struct free_block
+		{
+			free_block* next;
+		};
+
+		struct thread_cache
+		{
+			free_block* heads[class_count]{};
+			size_t counts[class_count]{};
+			pool_stats stats;
+
+			~thread_cache()
+			{
+				// arena中的块随arena一起释放
+				for (size_t i = 0; i < class_count; i++)
+				{
+					while (heads[i] != nullptr)
+					{
+						free_block* block = heads[i];
+						heads[i] = block->next;
+
+						if (!in_arena(block))
+							::operator delete(block);
+					}
+				}
+			}
+		};
+
+		static thread_cache& local()
+		{
+			static thread_local thread_cache cache;
+			return cache;
+		}
+
+		static void* arena_allocate(size_t size)
+		{
+			if (arena_begin == nullptr)
+				return nullptr;
+
+			if (arena_used.load(std::memory_order_relaxed) + size > arena_size)
+				return nullptr;
+
+			size_t offset = arena_used.fetch_add(size, std::memory_order_relaxed);
+			if (offset + size > arena_size)
+				return nullptr;
+
+			return arena_begin + offset;
+		}
+
+		static bool in_arena(const void* ptr)
+		{
+			return arena_begin != nullptr && (const char*)ptr >= arena_begin && (const char*)ptr < arena_begin + arena_size;
+		}
+
+	private:
+		static inline char* arena_begin{ nullptr };
+		static inline size_t arena_size{ 0 };
+		static inline std::atomic<size_t> arena_used{ 0 };
+	};
+}
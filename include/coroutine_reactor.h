@@ -0,0 +1,411 @@
+﻿#pragma once
+/*
+	基于epoll的fd就绪通知，由协程管理器在update中以0超时轮询
+	等待节点按fd挂入读、写两个链表，fd以EPOLLONESHOT关注，就绪一次后自动停止通知，
+	还有等待者时再重新关注，fd关闭后编号被复用也不会留下过期的注册。
+	等待者超时或被取消时由remove摘除，fd上没有等待者时从epoll中删除
+	fd需要设为非阻塞，除wake外只能在协程管理器所在的线程使用
+
+	run中空闲时阻塞在wait上，timerfd按微秒精度在下一个deadline唤醒，eventfd用于跨线程唤醒
+	没有epoll的平台只提供wait和wake
+*/
+
+#if defined __linux__ && !defined COROUTINE_NO_REACTOR
+#define COROUTINE_REACTOR 1
+#endif
+
+#if defined COROUTINE_REACTOR
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "coroutine_timer.h"
+
+namespace coroutine_reactor
+{
+	enum io_event : uint32_t
+	{
+		io_readable = EPOLLIN,
+		io_writable = EPOLLOUT,
+	};
+
+	// fd上的等待节点
+	struct io_node : public coroutine_timer::list_node
+	{
+		int fd{ -1 };
+		io_event event{ io_readable };
+	};
+
+	class reactor
+	{
+	public:
+		// 每次epoll_wait最多取出的事件数
+		static constexpr size_t max_events = 64;
+
+		reactor() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)), events(max_events)
+		{
+			if (epoll_fd < 0)
+			{
+				create_error = -errno;
+				return;
+			}
+
+			wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+			watch_internal(wake_fd);
+			watch_internal(timer_fd);
+		}
+
+		~reactor()
+		{
+			if (timer_fd >= 0)
+				::close(timer_fd);
+
+			if (wake_fd >= 0)
+				::close(wake_fd);
+
+			if (epoll_fd >= 0)
+				::close(epoll_fd);
+		}
+
+		reactor(const reactor&) = delete;
+		reactor& operator=(const reactor&) = delete;
+
+		bool valid() const
+		{
+			return epoll_fd >= 0;
+		}
+
+		// epoll的fd，可以加入其他fd一起等待
+		int native_handle() const
+		{
+			return epoll_fd;
+		}
+
+		// 没有关注中的fd时不需要轮询
+		bool empty() const
+		{
+			return armed_count == 0;
+		}
+
+		// 唤醒阻塞在wait中的线程，可以在任意线程调用
+		void wake()
+		{
+			uint64_t one = 1;
+			while (::write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+		}
+
+		// 阻塞到deadline、fd就绪或被wake，deadline为空时不超时
+		// steady_clock和timerfd都使用CLOCK_MONOTONIC
+		template<typename F>
+		size_t wait(const std::chrono::steady_clock::time_point* deadline, F&& on_ready)
+		{
+			if (epoll_fd < 0 || timer_fd < 0)
+			{
+				if (deadline != nullptr)
+					std::this_thread::sleep_until(*deadline);
+
+				return 0;
+			}
+
+			int64_t target = 0;
+			if (deadline != nullptr)
+			{
+				// 0会停止定时，已过期的deadline取最小值
+				target = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline->time_since_epoch()).count();
+				if (target <= 0)
+					target = 1;
+			}
+
+			// 与上次设置的相同时不再调用timerfd_settime
+			if (target != timer_target)
+			{
+				constexpr int64_t nanoseconds_per_second = 1000000000;
+
+				itimerspec spec{};
+				spec.it_value.tv_sec = (time_t)(target / nanoseconds_per_second);
+				spec.it_value.tv_nsec = (long)(target % nanoseconds_per_second);
+
+				timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+				timer_target = target;
+			}
+
+			return poll(-1, std::forward<F>(on_ready));
+		}
+
+		// 挂入fd的等待链表，失败时返回-errno
+		int add(io_node* node)
+		{
+			if (epoll_fd < 0)
+				return create_error;
+
+			if (node->fd < 0)
+				return -EBADF;
+
+			while (entries.size() <= (size_t)node->fd)
+				entries.emplace_back();
+
+			fd_entry& entry = entries[node->fd];
+
+			// 每次都重新关注，之前的等待者所在的fd可能已被关闭，编号被复用
+			int error = arm(node->fd, entry, waiting(entry) | node->event);
+			if (error != 0)
+				return error;
+
+			list_of(entry, node->event).push_back(node);
+			return 0;
+		}
+
+		// 等待者超时、被取消或销毁时摘除，按fd上剩下的等待者重新关注，没有等待者时停止关注
+		void remove(io_node* node)
+		{
+			if (!node->is_linked())
+				return;
+
+			node->unlink();
+
+			if (node->fd < 0 || (size_t)node->fd >= entries.size())
+				return;
+
+			fd_entry& entry = entries[node->fd];
+			uint32_t interest = waiting(entry);
+
+			if (interest == 0)
+				disarm(node->fd, entry);
+			else if (interest != entry.armed)
+				arm(node->fd, entry, interest);
+		}
+
+		// 取出就绪的fd，对等待节点依次调用on_ready(node)，返回false表示fd已不再就绪，
+		// 此节点和之后的节点继续等待。timeout_ms为-1时一直阻塞，返回完成的节点数
+		template<typename F>
+		size_t poll(int timeout_ms, F&& on_ready)
+		{
+			if (epoll_fd < 0)
+				return 0;
+
+			int count = epoll_wait(epoll_fd, events.data(), (int)events.size(), timeout_ms);
+			if (count <= 0)
+				return 0;
+
+			size_t completed = 0;
+
+			for (int i = 0; i < count; i++)
+			{
+				int fd = events[i].data.fd;
+
+				if (fd == wake_fd || fd == timer_fd)
+				{
+					drain(fd);
+					continue;
+				}
+
+				if (fd < 0 || (size_t)fd >= entries.size())
+					continue;
+
+				fd_entry& entry = entries[fd];
+				if (entry.armed != 0)
+				{
+					entry.armed = 0;
+					armed_count--;
+				}
+
+				// 出错或挂断时读写都唤醒，由io调用取得具体的错误
+				uint32_t flags = events[i].events;
+				if ((flags & (EPOLLERR | EPOLLHUP)) != 0)
+					flags |= EPOLLIN | EPOLLOUT;
+
+				if ((flags & EPOLLIN) != 0)
+					completed += dispatch(entry.readers, on_ready);
+
+				if ((flags & EPOLLOUT) != 0)
+					completed += dispatch(entry.writers, on_ready);
+
+				if (waiting(entry) != 0)
+					arm(fd, entry, waiting(entry));
+			}
+
+			return completed;
+		}
+
+	private:
+		struct fd_entry
+		{
+			coroutine_timer::intrusive_list readers;
+			coroutine_timer::intrusive_list writers;
+			// 当前关注的事件，就绪后为0
+			uint32_t armed{ 0 };
+			bool registered{ false };
+		};
+
+		// eventfd和timerfd一直关注，可读时由poll读空
+		void watch_internal(int fd)
+		{
+			if (fd < 0)
+				return;
+
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.fd = fd;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+		}
+
+		void drain(int fd)
+		{
+			uint64_t count = 0;
+			while (::read(fd, &count, sizeof(count)) > 0);
+
+			// 定时已触发，下次wait需要重新设置
+			if (fd == timer_fd)
+				timer_target = 0;
+		}
+
+		static coroutine_timer::intrusive_list& list_of(fd_entry& entry, io_event event)
+		{
+			return event == io_readable ? entry.readers : entry.writers;
+		}
+
+		static uint32_t waiting(const fd_entry& entry)
+		{
+			return (entry.readers.empty() ? 0 : (uint32_t)EPOLLIN) | (entry.writers.empty() ? 0 : (uint32_t)EPOLLOUT);
+		}
+
+		int arm(int fd, fd_entry& entry, uint32_t interest)
+		{
+			epoll_event event{};
+			event.events = interest | EPOLLONESHOT;
+			event.data.fd = fd;
+
+			int result = epoll_ctl(epoll_fd, entry.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+
+			// fd关闭后epoll已自动移除，或者编号被复用前没有关注过
+			if (result < 0 && errno == ENOENT)
+				result = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+			else if (result < 0 && errno == EEXIST)
+				result = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+
+			if (result < 0)
+				return -errno;
+
+			entry.registered = true;
+			if (entry.armed == 0)
+				armed_count++;
+
+			entry.armed = interest;
+			return 0;
+		}
+
+		// fd可能已被关闭，删除失败时忽略
+		void disarm(int fd, fd_entry& entry)
+		{
+			if (entry.registered)
+			{
+				epoll_event event{};
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &event);
+				entry.registered = false;
+			}
+
+			if (entry.armed != 0)
+			{
+				entry.armed = 0;
+				armed_count--;
+			}
+		}
+
+		template<typename F>
+		static size_t dispatch(coroutine_timer::intrusive_list& waiters, F& on_ready)
+		{
+			coroutine_timer::intrusive_list pending;
+			pending.splice(waiters);
+
+			size_t completed = 0;
+
+			while (!pending.empty())
+			{
+				io_node* node = static_cast<io_node*>(pending.pop_front());
+
+				if (on_ready(node))
+				{
+					completed++;
+					continue;
+				}
+
+				// fd已不再就绪，剩下的按原顺序继续等待
+				waiters.push_back(node);
+				waiters.splice(pending);
+				break;
+			}
+
+			return completed;
+		}
+
+		int epoll_fd;
+		int wake_fd{ -1 };
+		int timer_fd{ -1 };
+		// 当前timerfd的绝对时间，0表示没有设置
+		int64_t timer_target{ 0 };
+		int create_error{ 0 };
+		size_t armed_count{ 0 };
+		std::vector<epoll_event> events;
+		// 按fd索引，deque扩容时不移动已有的链表
+		std::deque<fd_entry> entries;
+	};
+}
+
+#else
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+namespace coroutine_reactor
+{
+	// 没有epoll时只提供阻塞等待和跨线程唤醒
+	class reactor
+	{
+	public:
+		bool empty() const
+		{
+			return true;
+		}
+
+		void wake()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				woken = true;
+			}
+
+			condition.notify_one();
+		}
+
+		// 阻塞到deadline或被wake，deadline为空时不超时
+		void wait(const std::chrono::steady_clock::time_point* deadline)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (deadline != nullptr)
+				condition.wait_until(lock, *deadline, [this]() { return woken; });
+			else
+				condition.wait(lock, [this]() { return woken; });
+
+			woken = false;
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool woken{ false };
+	};
+}
+
+#endif
@@ -0,0 +1,173 @@
+﻿#pragma once
+/*
+	deadline扫描
+	在连续存放的deadline数组中找出已到期(deadline <= now)的下标，
+	运行时按cpu支持选择avx512、avx2或标量实现，定义COROUTINE_NO_SIMD只使用标量实现
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <limits>
+
+#if !defined COROUTINE_NO_SIMD && (defined __x86_64__ || defined _M_X64)
+#define COROUTINE_SCAN_X86 1
+#include <immintrin.h>
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined COROUTINE_SCAN_X86 && (defined __GNUC__ || defined __clang__)
+#define COROUTINE_SCAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define COROUTINE_SCAN_TARGET(isa)
+#endif
+
+namespace coroutine_scan
+{
+	typedef void (*scan_function)(const uint64_t* deadlines, size_t count, uint64_t now, std::vector<uint32_t>& expired);
+
+	// 到期的下标按升序追加到expired
+	inline void scan_scalar(const uint64_t* deadlines, size_t count, uint64_t now, std::vector<uint32_t>& expired)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (deadlines[i] <= now)
+				expired.push_back((uint32_t)i);
+		}
+	}
+
+#if defined COROUTINE_SCAN_X86
+	// avx2没有无符号64位比较，两边翻转符号位后用有符号比较
+	COROUTINE_SCAN_TARGET("avx2")
+	inline void scan_avx2(const uint64_t* deadlines, size_t count, uint64_t now, std::vector<uint32_t>& expired)
+	{
+		const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ull);
+		const __m256i limit = _mm256_xor_si256(_mm256_set1_epi64x((long long)now), sign);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m256i value = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(deadlines + i)), sign);
+			unsigned int later = (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(value, limit)));
+			unsigned int mask = ~later & 0xFu;
+
+			while (mask != 0)
+			{
+				unsigned long bit = 0;
+#if defined _MSC_VER
+				_BitScanForward(&bit, mask);
+#else
+				bit = (unsigned long)__builtin_ctz(mask);
+#endif
+				expired.push_back((uint32_t)(i + bit));
+				mask &= mask - 1;
+			}
+		}
+
+		for (; i < count; i++)
+		{
+			if (deadlines[i] <= now)
+				expired.push_back((uint32_t)i);
+		}
+	}
+
+	COROUTINE_SCAN_TARGET("avx512f")
+	inline void scan_avx512(const uint64_t* deadlines, size_t count, uint64_t now, std::vector<uint32_t>& expired)
+	{
+		const __m512i limit = _mm512_set1_epi64((long long)now);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			unsigned int mask = (unsigned int)_mm512_cmple_epu64_mask(_mm512_loadu_si512((const void*)(deadlines + i)), limit);
+
+			while (mask != 0)
+			{
+				unsigned long bit = 0;
+#if defined _MSC_VER
+				_BitScanForward(&bit, mask);
+#else
+				bit = (unsigned long)__builtin_ctz(mask);
+#endif
+				expired.push_back((uint32_t)(i + bit));
+				mask &= mask - 1;
+			}
+		}
+
+		for (; i < count; i++)
+		{
+			if (deadlines[i] <= now)
+				expired.push_back((uint32_t)i);
+		}
+	}
+
+	// 检查cpu和操作系统是否都支持对应的寄存器
+	inline bool cpu_supports(bool avx512)
+	{
+#if defined _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		// osxsave和avx
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+			return false;
+
+		unsigned long long xcr0 = _xgetbv(0);
+		if ((xcr0 & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		if (!avx512)
+			return (info[1] & (1 << 5)) != 0;
+
+		return (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE0) == 0xE0;
+#else
+		__builtin_cpu_init();
+
+		return avx512 ? __builtin_cpu_supports("avx512f") : __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	// 当前cpu上使用的实现名称
+	inline const char* get_scan_isa()
+	{
+#if defined COROUTINE_SCAN_X86
+		static const char* isa = cpu_supports(true) ? "avx512" : (cpu_supports(false) ? "avx2" : "scalar");
+		return isa;
+#else
+		return "scalar";
+#endif
+	}
+
+	inline scan_function get_scan_function()
+	{
+#if defined COROUTINE_SCAN_X86
+		static const scan_function function = cpu_supports(true) ? scan_avx512 : (cpu_supports(false) ? scan_avx2 : scan_scalar);
+		return function;
+#else
+		return scan_scalar;
+#endif
+	}
+
+	inline void scan_expired(const uint64_t* deadlines, size_t count, uint64_t now, std::vector<uint32_t>& expired)
+	{
+		get_scan_function()(deadlines, count, now, expired);
+	}
+
+	// 最早的deadline，没有时返回最大值。循环没有分支，编译器可以自动向量化
+	inline uint64_t min_deadline(const uint64_t* deadlines, size_t count)
+	{
+		uint64_t earliest = std::numeric_limits<uint64_t>::max();
+
+		for (size_t i = 0; i < count; i++)
+			earliest = deadlines[i] < earliest ? deadlines[i] : earliest;
+
+		return earliest;
+	}
+}
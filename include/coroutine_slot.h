@@ -0,0 +1,231 @@
+﻿#pragma once
+/*
+	协程槽位表
+	槽位的各项属性按列分别存放(状态、等待类型、优先级、标记、deadline、代数、句柄)，
+	调度时只访问需要的列，不必为了查询状态去读协程帧。
+	协程id为(index << 32) | generation，槽位每次释放时代数加一，旧id随即失效
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <limits>
+
+namespace coroutine_slot
+{
+	// 槽位状态
+	enum class slot_state : uint8_t
+	{
+		free,
+		// 正在执行
+		running,
+		// 挂起等待
+		suspended,
+	};
+
+	// 挂起时的等待类型
+	enum class wait_kind : uint8_t
+	{
+		none,
+		timer,
+		ready,
+		polling,
+		event,
+		coroutine,
+		io,
+		sync,
+	};
+
+	// wait_kind的数量，增加类型时同步修改
+	static constexpr size_t wait_kind_count = (size_t)wait_kind::sync + 1;
+
+	// 槽位标记，按位组合
+	enum slot_flag : uint8_t
+	{
+		// 已请求取消
+		flag_cancelled = 1,
+		// 运行中被删除，挂起后回收
+		flag_destroy_pending = 2,
+	};
+
+	// 优先级，update超出预算时先恢复优先级高的协程
+	enum class priority : uint8_t
+	{
+		critical,
+		normal,
+		background,
+	};
+
+	static constexpr size_t priority_count = 3;
+
+	template<typename Handle>
+	class slot_table
+	{
+	public:
+		static constexpr uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+		static constexpr uint64_t no_deadline = std::numeric_limits<uint64_t>::max();
+
+	public:
+		slot_table() { }
+
+		slot_table(const slot_table&) = delete;
+		slot_table& operator=(const slot_table&) = delete;
+
+		static size_t index_of(uint64_t id)
+		{
+			return (size_t)(id >> 32);
+		}
+
+		// 分配槽位并返回id，槽位用尽时返回0
+		uint64_t allocate(Handle handle)
+		{
+			size_t index;
+			if (free_head != invalid_index)
+			{
+				index = free_head;
+				free_head = next_free[index];
+			}
+			else
+			{
+				index = states.size();
+				if (index >= invalid_index)
+					return (uint64_t)0;
+
+				states.push_back(slot_state::free);
+				kinds.push_back(wait_kind::none);
+				priorities.push_back(priority::normal);
+				flags.push_back(0);
+				deadlines.push_back(no_deadline);
+				generations.push_back(1);
+				handles.push_back(nullptr);
+				next_free.push_back(invalid_index);
+			}
+
+			states[index] = slot_state::running;
+			kinds[index] = wait_kind::none;
+			priorities[index] = priority::normal;
+			flags[index] = 0;
+			deadlines[index] = no_deadline;
+			handles[index] = handle;
+			next_free[index] = invalid_index;
+			++live;
+
+			return ((uint64_t)index << 32) | generations[index];
+		}
+
+		// 释放槽位，压入空闲栈
+		void release(size_t index)
+		{
+			states[index] = slot_state::free;
+			kinds[index] = wait_kind::none;
+			flags[index] = 0;
+			deadlines[index] = no_deadline;
+			handles[index] = nullptr;
+
+			// 代数为0的id永远无效
+			if (++generations[index] == 0)
+				generations[index] = 1;
+
+			next_free[index] = free_head;
+			free_head = (uint32_t)index;
+			--live;
+		}
+
+		// id是否对应一个未释放的槽位
+		bool contains(uint64_t id) const
+		{
+			size_t index = index_of(id);
+
+			return index < generations.size() && generations[index] == (uint32_t)id && states[index] != slot_state::free;
+		}
+
+		size_t size() const
+		{
+			return states.size();
+		}
+
+		// 未释放的槽位数
+		size_t live_count() const
+		{
+			return live;
+		}
+
+		// 已分配但空闲，可以直接复用的槽位数
+		size_t free_count() const
+		{
+			return states.size() - live;
+		}
+
+		Handle get_handle(size_t index) const
+		{
+			return handles[index];
+		}
+
+		slot_state get_state(size_t index) const
+		{
+			return states[index];
+		}
+
+		void set_state(size_t index, slot_state state)
+		{
+			states[index] = state;
+		}
+
+		wait_kind get_wait_kind(size_t index) const
+		{
+			return kinds[index];
+		}
+
+		priority get_priority(size_t index) const
+		{
+			return priorities[index];
+		}
+
+		void set_priority(size_t index, priority _priority)
+		{
+			priorities[index] = _priority;
+		}
+
+		bool has_flag(size_t index, slot_flag flag) const
+		{
+			return (flags[index] & flag) != 0;
+		}
+
+		void set_flag(size_t index, slot_flag flag)
+		{
+			flags[index] |= flag;
+		}
+
+		uint64_t get_deadline(size_t index) const
+		{
+			return deadlines[index];
+		}
+
+		// 连续的deadline列，供批量扫描
+		const uint64_t* get_deadlines() const
+		{
+			return deadlines.data();
+		}
+
+		// 记录挂起的等待类型，没有deadline的传no_deadline
+		void set_wait(size_t index, wait_kind kind, uint64_t deadline)
+		{
+			states[index] = slot_state::suspended;
+			kinds[index] = kind;
+			deadlines[index] = deadline;
+		}
+
+	private:
+		std::vector<slot_state> states;
+		std::vector<wait_kind> kinds;
+		std::vector<priority> priorities;
+		std::vector<uint8_t> flags;
+		std::vector<uint64_t> deadlines;
+		std::vector<uint32_t> generations;
+		std::vector<Handle> handles;
+		// 空闲槽位串成的栈，最近释放的最先复用
+		std::vector<uint32_t> next_free;
+		uint32_t free_head{ invalid_index };
+		size_t live{ 0 };
+	};
+}
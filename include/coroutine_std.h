@@ -0,0 +1,16 @@
+﻿#pragma once
+/*
+	协程标准库选择
+	编译器支持C++20协程时使用<coroutine>，否则退回<experimental/coroutine>(如msvc的/await)，
+	定义COROUTINE_USE_EXPERIMENTAL可强制使用后者
+*/
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>) && !defined(COROUTINE_USE_EXPERIMENTAL)
+#include <coroutine>
+
+namespace coroutine_std = std;
+#else
+#include <experimental/coroutine>
+
+namespace coroutine_std = std::experimental;
+#endif
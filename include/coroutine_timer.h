@@ -0,0 +1,508 @@
+﻿#pragma once
+/*
+	分层时间轮
+	定时等待按绝对到期tick挂入时间轮，update时只处理真正到期的节点，
+	开销与唤醒数量成正比，与挂起的协程总数无关
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <bit>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+#include <cmath>
+
+namespace coroutine_timer
+{
+	// 等待时长统一按纳秒保存，挂起时再按协程管理器的tick精度换算成绝对deadline
+	typedef std::chrono::nanoseconds duration_t;
+
+	// 默认1ms一个tick
+	constexpr uint64_t default_ticks_per_second = 1000;
+
+	template<typename Rep, typename Period>
+	inline duration_t to_duration(const std::chrono::duration<Rep, Period>& value)
+	{
+		if (!(value > value.zero()))
+			return duration_t::zero();
+
+		// 超出纳秒的表示范围视为永久等待
+		if (std::chrono::duration<double>(value).count() >= std::chrono::duration<double>(duration_t::max()).count())
+			return duration_t::max();
+
+		return std::chrono::ceil<duration_t>(value);
+	}
+
+	// float只有24位有效位，按微秒四舍五入，避免1.1f之类的表示误差多出一个tick
+	inline duration_t seconds_to_duration(float seconds)
+	{
+		if (!(seconds > 0.0f))
+			return duration_t::zero();
+
+		double microseconds = std::round((double)seconds * 1000000.0);
+		if (microseconds >= (double)(duration_t::max().count() / 1000))
+			return duration_t::max();
+
+		return std::chrono::microseconds((int64_t)microseconds);
+	}
+
+	// 时长换算为tick数，向上取整
+	inline uint64_t duration_to_ticks(duration_t value, uint64_t ticks_per_second)
+	{
+		if (value <= duration_t::zero())
+			return 0;
+
+		if (value == duration_t::max())
+			return std::numeric_limits<uint64_t>::max();
+
+		constexpr uint64_t nanoseconds_per_second = 1000000000;
+
+		uint64_t count = (uint64_t)value.count();
+		uint64_t seconds = count / nanoseconds_per_second;
+		uint64_t remainder = count % nanoseconds_per_second;
+
+		if (seconds > std::numeric_limits<uint64_t>::max() / ticks_per_second)
+			return std::numeric_limits<uint64_t>::max();
+
+		// remainder < 1e9，ticks_per_second不超过1e9时乘积不会溢出
+		return seconds * ticks_per_second + (remainder * ticks_per_second + nanoseconds_per_second - 1) / nanoseconds_per_second;
+	}
+
+	// 经过的时长换算为tick数，向下取整，不足一个tick的部分留到下次
+	inline uint64_t elapsed_ticks(duration_t value, uint64_t ticks_per_second)
+	{
+		if (value <= duration_t::zero())
+			return 0;
+
+		constexpr uint64_t nanoseconds_per_second = 1000000000;
+
+		uint64_t count = (uint64_t)value.count();
+		return count / nanoseconds_per_second * ticks_per_second + count % nanoseconds_per_second * ticks_per_second / nanoseconds_per_second;
+	}
+
+	// tick数换算为时长，向上取整，按它睡眠时不会在tick到达前醒来
+	inline duration_t ticks_to_duration(uint64_t ticks, uint64_t ticks_per_second)
+	{
+		constexpr uint64_t nanoseconds_per_second = 1000000000;
+
+		uint64_t seconds = ticks / ticks_per_second;
+		uint64_t remainder = ticks % ticks_per_second;
+
+		if (seconds >= (uint64_t)duration_t::max().count() / nanoseconds_per_second)
+			return duration_t::max();
+
+		return duration_t((int64_t)(seconds * nanoseconds_per_second + (remainder * nanoseconds_per_second + ticks_per_second - 1) / ticks_per_second));
+	}
+
+	// tick + ticks，溢出时取最大值
+	inline uint64_t add_ticks(uint64_t tick, uint64_t ticks)
+	{
+		return ticks > std::numeric_limits<uint64_t>::max() - tick ? std::numeric_limits<uint64_t>::max() : tick + ticks;
+	}
+
+	// 侵入式双向链表节点，析构时自动从所在链表中摘除
+	struct list_node
+	{
+		list_node* prev{ nullptr };
+		list_node* next{ nullptr };
+
+		list_node() { }
+
+		// 复制不继承链接关系
+		list_node(const list_node&) { }
+
+		// 析构时自动摘除
+		~list_node()
+		{
+			unlink();
+		}
+
+		list_node& operator=(const list_node&)
+		{
+			return *this;
+		}
+
+		bool is_linked() const
+		{
+			return next != nullptr;
+		}
+
+		void unlink()
+		{
+			if (next == nullptr)
+				return;
+
+			prev->next = next;
+			next->prev = prev;
+			prev = nullptr;
+			next = nullptr;
+		}
+	};
+
+	// 带哨兵的循环链表，不拥有节点
+	class intrusive_list
+	{
+	public:
+		intrusive_list()
+		{
+			head.prev = &head;
+			head.next = &head;
+		}
+
+		intrusive_list(const intrusive_list&) = delete;
+		intrusive_list& operator=(const intrusive_list&) = delete;
+
+		~intrusive_list()
+		{
+			clear();
+		}
+
+		bool empty() const
+		{
+			return head.next == &head;
+		}
+
+		void push_back(list_node* node)
+		{
+			node->unlink();
+
+			node->prev = head.prev;
+			node->next = &head;
+			head.prev->next = node;
+			head.prev = node;
+		}
+
+		list_node* front() const
+		{
+			return empty() ? nullptr : head.next;
+		}
+
+		// 哨兵节点，遍历到此结束
+		const list_node* end() const
+		{
+			return &head;
+		}
+
+		list_node* pop_front()
+		{
+			if (empty())
+				return nullptr;
+
+			list_node* node = head.next;
+			node->unlink();
+
+			return node;
+		}
+
+		// 把other的全部节点移到尾部
+		void splice(intrusive_list& other)
+		{
+			if (other.empty())
+				return;
+
+			list_node* first = other.head.next;
+			list_node* last = other.head.prev;
+
+			first->prev = head.prev;
+			last->next = &head;
+			head.prev->next = first;
+			head.prev = last;
+
+			other.head.prev = &other.head;
+			other.head.next = &other.head;
+		}
+
+		void clear()
+		{
+			while (pop_front() != nullptr);
+		}
+
+	private:
+		list_node head;
+	};
+
+	// 定时节点，deadline为绝对到期tick
+	struct timer_node : public list_node
+	{
+		uint64_t deadline{ 0 };
+	};
+
+	class timer_wheel
+	{
+	public:
+		static constexpr unsigned int slot_bits = 8;
+		static constexpr unsigned int slot_count = 1u << slot_bits;
+		static constexpr unsigned int slot_mask = slot_count - 1;
+		static constexpr unsigned int level_count = 4;
+		static constexpr unsigned int bitmap_words = slot_count / 64;
+		// 超出此范围的节点先放在最高层，级联时重新计算位置
+		static constexpr uint64_t max_delta = (uint64_t)1 << (slot_bits * level_count);
+
+	public:
+		timer_wheel(uint64_t tick) : current(tick)
+		{
+		}
+
+		timer_wheel(const timer_wheel&) = delete;
+		timer_wheel& operator=(const timer_wheel&) = delete;
+
+		// 下一个待处理的tick，小于它的deadline都已到期
+		uint64_t get_current() const
+		{
+			return current;
+		}
+
+		// 挂入定时节点，已过期的deadline在下一次advance时到期
+		void schedule(timer_node* node, uint64_t deadline)
+		{
+			if (deadline < current)
+				deadline = current;
+
+			node->deadline = deadline;
+			place(node);
+		}
+
+		static void cancel(timer_node* node)
+		{
+			node->unlink();
+		}
+
+		// 推进到now(包含)，到期节点按deadline顺序移入expired
+		void advance(uint64_t now, intrusive_list& expired)
+		{
+			while (current <= now)
+			{
+				unsigned int index = (unsigned int)(current & slot_mask);
+				if (index == 0)
+					cascade();
+
+				// 最低层为空时直接跳到下一个需要级联的tick
+				if (is_level_empty(0))
+				{
+					uint64_t next = next_cascade();
+					if (next > now)
+					{
+						current = now + 1;
+						break;
+					}
+
+					current = next;
+					continue;
+				}
+
+				// 在下次级联前的范围内查找第一个非空槽
+				uint64_t limit = current | slot_mask;
+				if (limit > now)
+					limit = now;
+
+				unsigned int last = (unsigned int)(limit & slot_mask);
+				unsigned int next = find_next(0, index, last);
+				if (next > last)
+				{
+					current = limit + 1;
+					continue;
+				}
+
+				current += next - index;
+				clear_bit(0, next);
+				expired.splice(slots[0][next]);
+
+				++current;
+			}
+		}
+
+		// 最早可能有节点到期的tick，没有节点时返回最大值
+		// 高层的节点按它级联的tick估计，级联后再重新计算
+		uint64_t next_expiry() const
+		{
+			unsigned int index = (unsigned int)(current & slot_mask);
+
+			// 处于级联位置时高层的当前槽在本tick级联
+			if (index == 0)
+			{
+				for (unsigned int level = 1; level < level_count; level++)
+				{
+					unsigned int upper = (unsigned int)((current >> (slot_bits * level)) & slot_mask);
+					if (!slots[level][upper].empty())
+						return current;
+
+					if (upper != 0)
+						break;
+				}
+			}
+
+			uint64_t base = current - index;
+
+			unsigned int next = find_occupied(0, index, slot_mask);
+			if (next < slot_count)
+				return base + next;
+
+			// 回绕到下一轮的槽
+			uint64_t earliest = std::numeric_limits<uint64_t>::max();
+			if (index > 0)
+			{
+				next = find_occupied(0, 0, index - 1);
+				if (next < slot_count)
+					earliest = base + slot_count + next;
+			}
+
+			for (unsigned int level = 1; level < level_count; level++)
+			{
+				unsigned int shift = slot_bits * level;
+				unsigned int upper = (unsigned int)((current >> shift) & slot_mask);
+
+				if (upper < slot_mask)
+				{
+					next = find_occupied(level, upper + 1, slot_mask);
+					if (next < slot_count)
+						return std::min(earliest, ((current >> shift) - upper + next) << shift);
+				}
+
+				// 本层剩余的槽要等到上一层下次级联之后
+				if (find_occupied(level, 0, slot_mask) < slot_count)
+					return std::min(earliest, ((current >> (shift + slot_bits)) + 1) << (shift + slot_bits));
+			}
+
+			return earliest;
+		}
+
+	private:
+		// [first, last]中第一个非空的槽，跳过已被摘空的残留位
+		unsigned int find_occupied(unsigned int level, unsigned int first, unsigned int last) const
+		{
+			while (first <= last)
+			{
+				unsigned int next = find_next(level, first, last);
+				if (next > last)
+					return slot_count;
+
+				if (!slots[level][next].empty())
+					return next;
+
+				first = next + 1;
+			}
+
+			return slot_count;
+		}
+
+		void place(timer_node* node)
+		{
+			uint64_t delta = node->deadline - current;
+			uint64_t expires = node->deadline;
+			if (delta >= max_delta)
+			{
+				delta = max_delta - 1;
+				expires = current + delta;
+			}
+
+			unsigned int level = 0;
+			while (level + 1 < level_count && delta >= ((uint64_t)1 << (slot_bits * (level + 1))))
+				++level;
+
+			unsigned int index = (unsigned int)((expires >> (slot_bits * level)) & slot_mask);
+
+			slots[level][index].push_back(node);
+			set_bit(level, index);
+		}
+
+		// 把高层当前槽的节点重新分配到低层
+		void cascade()
+		{
+			for (unsigned int level = 1; level < level_count; level++)
+			{
+				unsigned int index = (unsigned int)((current >> (slot_bits * level)) & slot_mask);
+
+				if (test_bit(level, index))
+				{
+					clear_bit(level, index);
+
+					intrusive_list pending;
+					pending.splice(slots[level][index]);
+
+					while (!pending.empty())
+						place(static_cast<timer_node*>(pending.pop_front()));
+				}
+
+				if (index != 0)
+					break;
+			}
+		}
+
+		bool is_level_empty(unsigned int level) const
+		{
+			for (unsigned int i = 0; i < bitmap_words; i++)
+			{
+				if (bitmaps[level][i] != 0)
+					return false;
+			}
+
+			return true;
+		}
+
+		// 下一个有节点需要级联的tick，没有则返回最大值
+		uint64_t next_cascade() const
+		{
+			for (unsigned int level = 1; level < level_count; level++)
+			{
+				unsigned int shift = slot_bits * level;
+				unsigned int index = (unsigned int)((current >> shift) & slot_mask);
+
+				if (index < slot_mask)
+				{
+					unsigned int next = find_next(level, index + 1, slot_mask);
+					if (next < slot_count)
+						return ((current >> shift) - index + next) << shift;
+				}
+
+				// 本层剩余的槽要等到上一层下次级联之后
+				if (!is_level_empty(level))
+					return ((current >> (shift + slot_bits)) + 1) << (shift + slot_bits);
+			}
+
+			return std::numeric_limits<uint64_t>::max();
+		}
+
+		// 返回[first, last]中第一个置位的槽，没有则返回slot_count
+		unsigned int find_next(unsigned int level, unsigned int first, unsigned int last) const
+		{
+			unsigned int word = first / 64;
+			uint64_t bits = bitmaps[level][word] & (~(uint64_t)0 << (first % 64));
+
+			while (true)
+			{
+				if (bits != 0)
+				{
+					unsigned int index = word * 64 + (unsigned int)std::countr_zero(bits);
+					return index <= last ? index : slot_count;
+				}
+
+				if (++word >= bitmap_words || word * 64 > last)
+					return slot_count;
+
+				bits = bitmaps[level][word];
+			}
+		}
+
+		// 位图可能残留已被摘空的槽，访问时再清除
+		void set_bit(unsigned int level, unsigned int index)
+		{
+			bitmaps[level][index / 64] |= (uint64_t)1 << (index % 64);
+		}
+
+		void clear_bit(unsigned int level, unsigned int index)
+		{
+			bitmaps[level][index / 64] &= ~((uint64_t)1 << (index % 64));
+		}
+
+		bool test_bit(unsigned int level, unsigned int index) const
+		{
+			return (bitmaps[level][index / 64] & ((uint64_t)1 << (index % 64))) != 0;
+		}
+
+	private:
+		uint64_t current;
+		uint64_t bitmaps[level_count][bitmap_words]{};
+		intrusive_list slots[level_count][slot_count];
+	};
+}
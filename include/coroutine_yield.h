@@ -10,7 +10,36 @@
 
 #include <vector>
 #include <queue>
-#include <experimental/coroutine>
+#include <unordered_map>
+#include <deque>
+#include <limits>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <type_traits>
+#include <optional>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <assert.h>
+
+#include "coroutine_std.h"
+#include "coroutine_timer.h"
+#include "coroutine_pool.h"
+#include "coroutine_slot.h"
+#include "coroutine_scan.h"
+#include "coroutine_inbox.h"
+#include "coroutine_event.h"
+#include "coroutine_cancel.h"
+#include "coroutine_channel.h"
+#include "coroutine_metrics.h"
+#include "coroutine_reactor.h"
+
+#if defined COROUTINE_REACTOR
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
 
 namespace coroutine_yield
 {
@@ -18,22 +47,93 @@ namespace coroutine_yield
 	typedef unsigned long long uint64_t;
 #endif
 
+	// 当前线程正在执行的协程管理器的tick
 	uint64_t get_cur_tick();
 
-	class yield_constructor
+	class coroutine_manager;
+
+	typedef coroutine_timer::duration_t duration_t;
+	typedef coroutine_event::delivery delivery;
+	typedef coroutine_cancel::cancellation_token cancellation_token;
+	typedef coroutine_cancel::cancellation_source cancellation_source;
+	typedef coroutine_metrics::coroutine_stats coroutine_stats;
+	typedef coroutine_metrics::manager_stats manager_stats;
+
+	// start时按等待类型挂入时间轮或轮询链表
+	class yield_constructor : public coroutine_timer::timer_node
 	{
 	public:
-		virtual ~yield_constructor() {}
+		virtual ~yield_constructor() { unlink(); }
 		virtual void start() = 0;
 		virtual bool can_resume() = 0;
-		virtual int trigger(int _event_id, void* _result) { return -1; }
+		virtual int trigger(int, void*) { return -1; }
+		virtual int trigger(int, coroutine_event::event_payload&) { return -1; }
+
+		// 恢复前从所有等待结构中摘除
+		virtual void detach() { unlink(); }
+
+		// 所在协程被取消，等待没有完成就恢复
+		bool is_cancelled() const { return cancelled; }
+
+		// 当前挂起在此constructor上的协程及其所属管理器
+		coroutine_std::coroutine_handle<> handle;
+		coroutine_manager* manager{ nullptr };
+		// 恢复时继续执行的协程帧，在生成器中等待时是生成器的协程帧
+		coroutine_std::coroutine_handle<> frame;
+		bool cancelled{ false };
+	};
+
+	// co_yield nullptr时使用，等待下一帧
+	class yield_next_frame : public yield_constructor
+	{
+	public:
+		void start() { }
+		bool can_resume() { return true; }
+	};
+
+	// 事件等待节点，按event_id挂入coroutine_manager的等待表
+	struct event_node : public coroutine_timer::list_node
+	{
+		yield_constructor* owner{ nullptr };
+	};
+
+#if defined COROUTINE_REACTOR
+	class io_constructor;
+
+	// fd等待节点，挂入coroutine_manager的reactor
+	struct fd_node : public coroutine_reactor::io_node
+	{
+		io_constructor* owner{ nullptr };
+	};
+#endif
+
+	// 依赖节点，挂入被等待协程的槽位，协程结束时通知owner
+	struct dependent_node : public coroutine_timer::list_node
+	{
+		yield_constructor* owner{ nullptr };
+		// 等待一组协程时的剩余数量，为0时owner就绪
+		size_t* remaining{ nullptr };
+	};
+
+	class sync_constructor;
+
+	// 同步结构的等待节点，挂入channel等的等待链表
+	struct sync_node : public coroutine_timer::list_node
+	{
+		sync_constructor* owner{ nullptr };
 	};
 
+	template<typename T>
+	struct generator_next;
+
+	template<typename T>
+	class generator_awaiter;
+
 	struct coroutine_t
 	{
 		// 内部属性
 		struct promise_type;
-		using handle_type = std::experimental::coroutine_handle<promise_type>; //type alias
+		using handle_type = coroutine_std::coroutine_handle<promise_type>; //type alias
 
 		coroutine_t(handle_type h) :
 			handle(h), id(0)
@@ -62,12 +162,7 @@ namespace coroutine_yield
 			if (!handle)
 				return true;
 
-			if (handle.done())
-				return true;
-
-			auto _promise = &handle.promise();
-
-			return handle.promise().constructor == nullptr;
+			return handle.done();
 		}
 
 		bool close()
@@ -86,10 +181,27 @@ namespace coroutine_yield
 		{
 			// wait constructor
 			yield_constructor* constructor{ nullptr };
+			yield_next_frame next_frame;
+			// 所属的管理器和协程id，由coroutine_manager::create_coroutine设置
+			coroutine_manager* manager{ nullptr };
+			uint64_t id{ 0 };
 
 			promise_type() { }
 			~promise_type() { }
 
+#if !defined COROUTINE_NO_FRAME_POOL
+			// 协程帧从内存池分配
+			static void* operator new(size_t size)
+			{
+				return coroutine_pool::frame_pool::allocate(size);
+			}
+
+			static void operator delete(void* ptr, size_t size)
+			{
+				coroutine_pool::frame_pool::deallocate(ptr, size);
+			}
+#endif
+
 			auto get_return_object() 
 			{
 				// 创建协程句柄
@@ -99,36 +211,32 @@ namespace coroutine_yield
 			auto initial_suspend()
 			{
 				// 初始化协程时调用
-				// 返回suspend_never，表示协程创建后不用中断，直接执行
-				// 返回suspend_always，表示协程创建后中断，并不执行，使用handler.resume来执行
-				return std::experimental::suspend_never{};
+				// 返回suspend_always，协程创建后先中断，由create_coroutine绑定管理器后再执行
+				return coroutine_std::suspend_always{};
 			}
 
-			auto final_suspend() 
+			auto final_suspend() noexcept
 			{
-				// 协程结束时调用
-				bool suspend = constructor != nullptr;
+				// 协程结束后保持挂起，由coroutine_manager回收协程帧
 				constructor = nullptr;
 
-				return std::experimental::suspend_if(suspend);
+				return coroutine_std::suspend_always{};
 			}
 
 			void return_void() 
 			{
 			}
 
-			auto yield_value(yield_constructor* _constructor)
-			{
-				// co_yield()时调用
-				if (_constructor != nullptr) 
-				{
-					_constructor->start();
-				}
+			// co_yield()时调用，默认挂入轮询链表，start中可改挂到时间轮、就绪队列或事件等待表
+			// co_yield nullptr等待下一帧
+			coroutine_std::suspend_always yield_value(yield_constructor* _constructor);
 
-				constructor = _constructor;
+			// co_yield gen.next()时调用，转到生成器执行，生成器产出值或结束时继续
+			template<typename T>
+			generator_awaiter<T> yield_value(generator_next<T> _next);
 
-				return std::experimental::suspend_always{};
-			}
+			// 挂起在constructor上，恢复时继续执行_frame，_frame可以是此协程中的生成器
+			coroutine_std::suspend_always wait_on(yield_constructor* _constructor, coroutine_std::coroutine_handle<> _frame);
 
 			void unhandled_exception() 
 			{
@@ -143,321 +251,2392 @@ namespace coroutine_yield
 	// 协程函数的格式
 	typedef coroutine_t(*coroutine_func) (...);
 
-	// 协程管理器
-	class coroutine_manager
+	// 生成器promise的公共部分，记录当前产出的值
+	template<typename T>
+	class generator_promise_base
 	{
 	public:
-		static coroutine_manager* instance;
+#if !defined COROUTINE_NO_FRAME_POOL
+		static void* operator new(size_t size)
+		{
+			return coroutine_pool::frame_pool::allocate(size);
+		}
 
-	public:
-		coroutine_manager(uint64_t tick) :
-			cur_tick (tick)
+		static void operator delete(void* ptr, size_t size)
 		{
+			coroutine_pool::frame_pool::deallocate(ptr, size);
 		}
+#endif
 
-		~coroutine_manager() 
+		// 第一次取值时才开始执行
+		auto initial_suspend()
 		{
+			return coroutine_std::suspend_always{};
 		}
 
-		uint64_t get_tick() const
+		void return_void()
 		{
-			return cur_tick;
 		}
 
-		void update(uint64_t tick)
+		void unhandled_exception()
 		{
-			cur_tick = tick;
+			exception = std::current_exception();
+		}
 
-			for (size_t i = 0; i < coroutines.size(); i++) 
-			{
-				if (coroutines[i].is_done()) 
-				{
-					if (coroutines[i].handle != nullptr)
-					{
-						coroutines[i].close();
-						free_indexes.emplace(i);
-					}
+		void rethrow_if_exception()
+		{
+			if (exception)
+				std::rethrow_exception(std::exchange(exception, nullptr));
+		}
 
-					continue;
-				}
+		bool has_value() const
+		{
+			return current != nullptr;
+		}
 
-				yield_constructor* constructor = coroutines[i].handle.promise().constructor;
-				if (constructor == nullptr)
-					continue;
+		T& value()
+		{
+			return *current;
+		}
 
-				if (constructor->can_resume())
-				{
-					coroutines[i].handle.resume();
-				}
-			}
+	protected:
+		// 右值在生成器恢复前一直有效，直接引用不复制
+		void store(T&& _value)
+		{
+			current = std::addressof(_value);
 		}
 
-		// 触发指定的事件
-		void trigger_event(int event_id, void* result) 
+		void store(const T& _value)
 		{
-			for (size_t i = 0; i < coroutines.size(); i++)
-			{
-				if (coroutines[i].is_done())
-					continue;
+			copy.emplace(_value);
+			current = std::addressof(*copy);
+		}
 
-				auto constructor = coroutines[i].handle.promise().constructor;
-				if (nullptr == constructor)
-					continue;
+		void clear()
+		{
+			current = nullptr;
+		}
 
-				int res = constructor->trigger(event_id, result);
-				if (res < 0)
-					continue;
+	private:
+		T* current{ nullptr };
+		std::optional<T> copy;
+		std::exception_ptr exception;
+	};
 
-				if (res >= 0)
-				{
-					coroutines[i].handle.resume();
-				}
-				
-				break;
-			}
+	template<typename T>
+	class generator;
+
+	// 同步生成器，按需计算下一个值，只能co_yield值，不能挂起等待
+	template<typename T>
+	class generator_promise : public generator_promise_base<T>
+	{
+	public:
+		generator<T> get_return_object();
+
+		auto final_suspend() noexcept
+		{
+			this->clear();
+
+			return coroutine_std::suspend_always{};
 		}
 
-		// 创建新协程
-		uint64_t create_coroutine(coroutine_t handler)
+		coroutine_std::suspend_always yield_value(T&& _value)
 		{
-			if (handler.is_done())
-				return (uint64_t)0;
+			this->store(std::move(_value));
+
+			return coroutine_std::suspend_always{};
+		}
+
+		coroutine_std::suspend_always yield_value(const T& _value)
+		{
+			this->store(_value);
+
+			return coroutine_std::suspend_always{};
+		}
 
-			size_t index;
-			if (free_indexes.size() > 0)
+		// 需要等待时使用async_generator
+		coroutine_std::suspend_always yield_value(yield_constructor* _constructor) = delete;
+
+		template<typename U>
+		void await_transform(U&&) = delete;
+	};
+
+	template<typename T>
+	class generator
+	{
+	public:
+		typedef generator_promise<T> promise_type;
+		typedef coroutine_std::coroutine_handle<promise_type> handle_type;
+
+		class iterator
+		{
+		public:
+			typedef std::input_iterator_tag iterator_category;
+			typedef std::ptrdiff_t difference_type;
+			typedef T value_type;
+
+			iterator() { }
+
+			explicit iterator(handle_type _handle) : handle(_handle)
 			{
-				index = free_indexes.front();
-				free_indexes.pop();
 			}
-			else
+
+			T& operator*() const
 			{
-				index = coroutines.size();
-				coroutines.emplace_back(coroutine_t(handler));
+				return handle.promise().value();
 			}
 
-			if (index > std::numeric_limits<unsigned int>::max())
+			iterator& operator++()
 			{
-				return (uint64_t)0;
+				advance(handle);
+				return *this;
 			}
 
-			++serial;
-			if (serial == 0)
-				serial = 1;
+			void operator++(int)
+			{
+				++*this;
+			}
+
+			bool operator==(std::default_sentinel_t) const
+			{
+				return !handle || handle.done();
+			}
 
-			uint64_t id = ((uint64_t)index << 32) | serial;
-			coroutines[index] = handler;
-			coroutines[index].id = id;
+		private:
+			handle_type handle;
+		};
 
-			return id;
+		explicit generator(handle_type _handle) : handle(_handle)
+		{
 		}
 
-		// 删除指定的协程，如果是当前协程，则此协程暂停后删除
-		bool destroy_coroutine(uint64_t id)
+		generator(generator&& other) noexcept : handle(other.handle)
 		{
-			unsigned int _index = (id >> 32);
-
-			if (_index > coroutines.size())
-				return false;
-
-			if (coroutines[_index].id != id)
-				return false;
+			other.handle = nullptr;
+		}
 
-			if (coroutines[_index].is_done())
-				return false;
+		generator& operator=(generator&& other) noexcept
+		{
+			if (this != &other)
+			{
+				close();
+				handle = other.handle;
+				other.handle = nullptr;
+			}
 
-			coroutines[_index].close();
+			return *this;
+		}
 
-			free_indexes.emplace(_index);
+		generator(const generator&) = delete;
+		generator& operator=(const generator&) = delete;
 
-			return true;
+		~generator()
+		{
+			close();
 		}
 
-		const coroutine_t* get_coroutine(uint64_t id)
+		// 开始执行到第一个值，只能遍历一次
+		iterator begin()
 		{
-			unsigned int _index = (id >> 32);
-
-			if (_index > coroutines.size())
-				return nullptr;
+			advance(handle);
+			return iterator(handle);
+		}
 
-			if (coroutines[_index].id != id)
-				return nullptr;
+		std::default_sentinel_t end()
+		{
+			return std::default_sentinel;
+		}
 
-			if (coroutines[_index].is_done())
-				return nullptr;
+	private:
+		static void advance(handle_type _handle)
+		{
+			if (!_handle || _handle.done())
+				return;
 
-			return &coroutines[_index];
+			_handle.resume();
+			_handle.promise().rethrow_if_exception();
 		}
 
-		bool exists_coroutine(uint64_t id)
+		void close()
 		{
-			return get_coroutine(id) != nullptr;
+			if (handle)
+			{
+				handle.destroy();
+				handle = nullptr;
+			}
 		}
 
-	private:
-		std::vector< coroutine_t> coroutines;
-		std::queue< size_t> free_indexes;
-
-		unsigned int serial{ 0 };
-		uint64_t cur_tick;
+		handle_type handle;
 	};
 
-	// 等待指定的时间
-	class wait_for_seconds : public yield_constructor
+	template<typename T>
+	inline generator<T> generator_promise<T>::get_return_object()
+	{
+		return generator<T>{ generator<T>::handle_type::from_promise(*this) };
+	}
+
+	template<typename T>
+	class async_generator;
+
+	// 异步生成器，产出值之间可以co_yield yield_constructor挂起等待，
+	// 挂起时由所在的顶层协程占用管理器的槽位，恢复时继续执行生成器
+	template<typename T>
+	class async_generator_promise : public generator_promise_base<T>
 	{
 	public:
-		wait_for_seconds(float seconds) : timeout_seconds(seconds)
-		{
-		}
+		typedef coroutine_std::coroutine_handle<async_generator_promise> handle_type;
 
-		void start()
+		async_generator<T> get_return_object();
+
+		// 产出值或结束时直接转回取值的协程帧，不经过管理器
+		struct transfer_awaiter
 		{
-			start_tick = get_cur_tick();
-		}
+			bool await_ready() noexcept
+			{
+				return false;
+			}
 
-		bool can_resume() 
+			coroutine_std::coroutine_handle<> await_suspend(handle_type _handle) noexcept
+			{
+				return _handle.promise().continuation;
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		transfer_awaiter final_suspend() noexcept
 		{
-			uint64_t cur_tick = get_cur_tick();
-			uint64_t sep = cur_tick - start_tick;
+			this->clear();
 
-			return (sep / 1000.0f >= timeout_seconds);
+			return transfer_awaiter{};
 		}
 
-	private:
-		// ms
-		uint64_t start_tick{ 0 };
-		float timeout_seconds;
-	};
-
-	// 等待下一帧
-	class wait_for_frame : public yield_constructor
-	{
-	public:
-		wait_for_frame() 
+		transfer_awaiter yield_value(T&& _value)
 		{
+			this->store(std::move(_value));
+
+			return transfer_awaiter{};
 		}
 
-		void start()
+		transfer_awaiter yield_value(const T& _value)
 		{
+			this->store(_value);
+
+			return transfer_awaiter{};
 		}
 
-		bool can_resume()
+		// 挂起等待，co_yield nullptr等待下一帧
+		coroutine_std::suspend_always yield_value(yield_constructor* _constructor)
 		{
-			return true;
+			this->clear();
+
+			return root.promise().wait_on(_constructor, handle_type::from_promise(*this));
 		}
+
+		// 在生成器中从另一个生成器取值
+		template<typename U>
+		generator_awaiter<U> yield_value(generator_next<U> _next);
+
+		// 取值的协程帧，产出值或结束时恢复
+		coroutine_std::coroutine_handle<> continuation;
+		// 所在的顶层协程
+		coroutine_t::handle_type root;
 	};
 
-	// 等待指定的事件
-	class wait_for_event : public yield_constructor
+	// gen.next()的返回值，co_yield时从生成器取下一个值
+	template<typename T>
+	struct generator_next
+	{
+		typename async_generator_promise<T>::handle_type producer;
+	};
+
+	// 直接转到生成器执行，生成器产出值或结束时直接恢复取值的协程帧，
+	// co_yield返回是否取到了值，生成器结束时返回false
+	template<typename T>
+	class generator_awaiter
 	{
 	public:
-		wait_for_event(int _event_id, float seconds) :
-			event_id(_event_id), timeout_seconds(seconds)
+		typedef typename async_generator_promise<T>::handle_type handle_type;
+
+		generator_awaiter(handle_type _producer, coroutine_t::handle_type _root) : producer(_producer), root(_root)
 		{
 		}
 
-		void start()
+		bool await_ready()
 		{
-			start_tick = get_cur_tick();
-			triggered = false;
+			return !producer || producer.done();
 		}
 
-		bool can_resume() 
+		coroutine_std::coroutine_handle<> await_suspend(coroutine_std::coroutine_handle<> _frame)
 		{
-			uint64_t cur_tick = get_cur_tick();
-			uint64_t sep = cur_tick - start_tick;
+			producer.promise().continuation = _frame;
+			producer.promise().root = root;
 
-			return (sep / 1000.0f >= timeout_seconds);
+			return producer;
 		}
 
-		// 返回-1: 不符, 0: 已触发, 1: 还未触发
-		virtual int trigger(int _event_id, void* _result) override
+		bool await_resume()
 		{
-			if (event_id != _event_id)
-				return -1;
-
-			if (triggered)
-				return 0;
-
-			triggered = true;
-			result = _result;
+			if (!producer)
+				return false;
 
-			return 1;
-		}
+			producer.promise().rethrow_if_exception();
 
-		int get_event_id() const
-		{
-			return event_id;
+			return !producer.done();
 		}
 
 	private:
-		// ms
-		uint64_t start_tick{ 0 };
-		bool triggered{ false };
-
-		int event_id;
-		float timeout_seconds;
-		
-	public:
-		void* result{ nullptr };
+		handle_type producer;
+		coroutine_t::handle_type root;
 	};
 
-	// 等待指定的协程完成
-	class wait_for_coroutine : public yield_constructor
+	// 在coroutine_t或另一个async_generator中使用：
+	// bool more = co_yield gen.next();
+	template<typename T>
+	class async_generator
 	{
 	public:
-		wait_for_coroutine(uint64_t _coroutine_id) : coroutine_id(_coroutine_id) 
+		typedef async_generator_promise<T> promise_type;
+		typedef coroutine_std::coroutine_handle<promise_type> handle_type;
+
+		explicit async_generator(handle_type _handle) : handle(_handle)
 		{
 		}
 
-		void start()
+		async_generator(async_generator&& other) noexcept : handle(other.handle)
 		{
+			other.handle = nullptr;
 		}
 
-		bool can_resume() 
+		async_generator& operator=(async_generator&& other) noexcept
+		{
+			if (this != &other)
+			{
+				close();
+				handle = other.handle;
+				other.handle = nullptr;
+			}
+
+			return *this;
+		}
+
+		async_generator(const async_generator&) = delete;
+		async_generator& operator=(const async_generator&) = delete;
+
+		~async_generator()
 		{
-			return !coroutine_manager::instance->exists_coroutine(coroutine_id);
+			close();
 		}
 
-		uint64_t getcoroutine_id() const 
+		// 取下一个值，用co_yield等待
+		generator_next<T> next()
 		{
-			return coroutine_id;
+			return generator_next<T>{ handle };
 		}
 
-	private:
-		uint64_t coroutine_id;
-	};
+		bool is_done() const
+		{
+			return !handle || handle.done();
+		}
 
-	// 等待指定的协程完成
-	class wait_for_coroutine_group : public yield_constructor
-	{
-	public:
-		wait_for_coroutine_group(uint64_t* _coroutine_group, size_t _count) :
-			wait_coroutine_groups(_coroutine_group), count(_count)
+		bool has_value() const
 		{
+			return !is_done() && handle.promise().has_value();
 		}
 
-		void start()
+		// 最近一次取到的值，再次取值前有效
+		T& value()
 		{
+			return handle.promise().value();
 		}
 
-		bool can_resume()
+	private:
+		void close()
 		{
-			for (size_t i = 0; i < count; i++)
+			if (handle)
 			{
-				if (coroutine_manager::instance->exists_coroutine(wait_coroutine_groups[i]))
-					return false;
+				handle.destroy();
+				handle = nullptr;
 			}
-
-			return true;
 		}
 
-	private:
-		uint64_t* wait_coroutine_groups;
-		size_t count;
+		handle_type handle;
 	};
 
-	inline uint64_t get_cur_tick()
+	template<typename T>
+	inline async_generator<T> async_generator_promise<T>::get_return_object()
 	{
-		return coroutine_manager::instance->get_tick();
+		return async_generator<T>{ async_generator<T>::handle_type::from_promise(*this) };
+	}
+
+	template<typename T>
+	template<typename U>
+	inline generator_awaiter<U> async_generator_promise<T>::yield_value(generator_next<U> _next)
+	{
+		return generator_awaiter<U>(_next.producer, root);
+	}
+
+	template<typename T>
+	inline generator_awaiter<T> coroutine_t::promise_type::yield_value(generator_next<T> _next)
+	{
+		return generator_awaiter<T>(_next.producer, handle_type::from_promise(*this));
+	}
+
+	// 协程管理器
+	// 定时等待的处理方式
+	enum class timer_mode
+	{
+		// 挂入时间轮，update只处理到期的节点，按deadline顺序恢复
+		wheel,
+		// 只记录在槽位表的deadline列，update时批量扫描，按槽位顺序恢复
+		scan,
+	};
+
+	// 协程结束时等待它的协程何时恢复
+	enum class resume_mode
+	{
+		// 挂入就绪队列，下一次update时恢复，依赖链每层延迟一帧
+		next_update,
+		// 在同一次update中接着恢复，依赖链在一次update内完成，与槽位顺序无关
+		cascade,
+	};
+
+	typedef coroutine_slot::priority priority;
+
+	// 一次update的预算，用完后剩余的恢复留到下一次update，按优先级先恢复critical
+	struct update_budget
+	{
+		// 最多恢复的协程数量
+		size_t resumes{ std::numeric_limits<size_t>::max() };
+		// 最长执行时间，为0时不限制
+		std::chrono::microseconds time{ 0 };
+
+		static update_budget unlimited()
+		{
+			return update_budget{};
+		}
+
+		static update_budget resumes_at_most(size_t count)
+		{
+			return update_budget{ count, std::chrono::microseconds(0) };
+		}
+
+		static update_budget time_slice(std::chrono::microseconds time)
+		{
+			return update_budget{ std::numeric_limits<size_t>::max(), time };
+		}
+	};
+
+	class coroutine_manager
+	{
+	public:
+		// 未通过create_coroutine绑定时使用的默认管理器，可以为空
+		static coroutine_manager* instance;
+
+		// 当前线程正在执行协程的管理器，不在管理器内时返回instance
+		static coroutine_manager* get_current()
+		{
+			return current != nullptr ? current : instance;
+		}
+
+	public:
+		// ticks_per_second为tick的精度，默认毫秒，可用微秒(1000000)或纳秒(1000000000)
+		// inbox_capacity为其他线程投递事件的队列容量
+		coroutine_manager(uint64_t tick, uint64_t _ticks_per_second = coroutine_timer::default_ticks_per_second,
+			size_t inbox_capacity = coroutine_inbox::mpsc_queue<int>::default_capacity) :
+			cur_tick (tick), ticks_per_second(_ticks_per_second), inbox(inbox_capacity), timers(tick)
+		{
+			assert(ticks_per_second > 0 && ticks_per_second <= 1000000000);
+		}
+
+		~coroutine_manager() 
+		{
+			// 未处理的投递只释放不触发
+			posted_event posted;
+			while (inbox.try_pop(posted))
+				posted.payload.reset();
+
+			// 剩余协程帧在此销毁，constructor析构时自动从等待结构中摘除
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) != coroutine_slot::slot_state::free)
+					close_slot(i);
+			}
+		}
+
+		uint64_t get_tick() const
+		{
+			return cur_tick;
+		}
+
+		uint64_t get_ticks_per_second() const
+		{
+			return ticks_per_second;
+		}
+
+		// 当前tick之后timeout的绝对deadline
+		uint64_t get_deadline(duration_t timeout) const
+		{
+			return coroutine_timer::add_ticks(cur_tick, coroutine_timer::duration_to_ticks(timeout, ticks_per_second));
+		}
+
+		// 返回下一次需要update的tick，见get_next_wakeup
+		uint64_t update(uint64_t tick)
+		{
+			return update(tick, update_budget::unlimited());
+		}
+
+		// 超出预算时剩余的恢复留在运行队列，下一次update优先处理
+		uint64_t update(uint64_t tick, update_budget budget)
+		{
+			current_scope scope(this);
+
+			cur_tick = tick;
+			metrics.begin_update();
+
+			// 其他线程投递的事件
+			drain_inbox();
+
+#if defined COROUTINE_REACTOR
+			// fd就绪的等待在此完成io，和就绪队列一起恢复
+			poll_io(0);
+#endif
+
+			// 只处理到期的定时等待
+			coroutine_timer::intrusive_list expired;
+			timers.advance(tick, expired);
+
+			while (!expired.empty())
+			{
+				enqueue(static_cast<yield_constructor*>(expired.pop_front()));
+			}
+
+			if (mode == timer_mode::scan)
+				enqueue_expired_slots(tick);
+
+			// 就绪队列，本帧新加入的留到下一帧
+			coroutine_timer::intrusive_list queued;
+			queued.splice(ready);
+			queued.splice(woken);
+
+			while (!queued.empty())
+			{
+				enqueue(static_cast<yield_constructor*>(queued.pop_front()));
+			}
+
+			budget_meter meter(budget);
+			run_queues(meter);
+
+			// 轮询的等待，本帧新挂起的留到下一帧
+			coroutine_timer::intrusive_list pending;
+			pending.splice(polling);
+
+			while (!pending.empty())
+			{
+				yield_constructor* constructor = static_cast<yield_constructor*>(pending.pop_front());
+
+				if (constructor->can_resume())
+					enqueue(constructor);
+				else
+					polling.push_back(constructor);
+			}
+
+			run_queues(meter);
+
+			// 本次update中结束的协程唤醒的等待者，超出预算的留到下一次update
+			size_t cascade_budget = resume_budget;
+			while (!woken.empty() && cascade_budget > 0 && meter.take())
+			{
+				--cascade_budget;
+				resume_constructor(static_cast<yield_constructor*>(woken.pop_front()));
+			}
+
+			ready.splice(woken);
+
+			metrics.end_update();
+			return get_next_wakeup();
+		}
+
+		// 没有任何需要按时间唤醒的等待
+		static constexpr uint64_t no_wakeup = std::numeric_limits<uint64_t>::max();
+
+		// 最早需要再次update的tick，有待恢复的协程时为当前tick，有轮询的等待时为下一个tick，
+		// 其余按最早的deadline，自己驱动循环的宿主可以据此睡眠
+		uint64_t get_next_wakeup() const
+		{
+			if (!ready.empty() || !woken.empty() || !inbox.empty())
+				return cur_tick;
+
+			for (size_t i = 0; i < coroutine_slot::priority_count; i++)
+			{
+				if (!queues[i].empty())
+					return cur_tick;
+			}
+
+			if (!polling.empty())
+				return coroutine_timer::add_ticks(cur_tick, 1);
+
+			if (mode == timer_mode::scan)
+				return coroutine_scan::min_deadline(slots.get_deadlines(), slots.size());
+
+			return timers.next_expiry();
+		}
+
+		// 阻塞运行直到stop，见run_until
+		void run()
+		{
+			run_until([]() { return false; });
+		}
+
+		// 阻塞运行，每次update后done返回true或调用了stop时返回
+		// tick按steady_clock从当前tick接着推进，空闲时睡到下一个deadline，fd就绪、post_event和wake会提前唤醒
+		template<typename Predicate>
+		void run_until(Predicate done)
+		{
+			typedef std::chrono::steady_clock clock;
+
+			clock::time_point start_time = clock::now();
+			uint64_t start_tick = cur_tick;
+
+			while (true)
+			{
+				uint64_t tick = start_tick + coroutine_timer::elapsed_ticks(clock::now() - start_time, ticks_per_second);
+				uint64_t next = update(tick);
+
+				if (done() || stopping.exchange(false, std::memory_order_acquire))
+					return;
+
+				if (next <= tick)
+					continue;
+
+				duration_t delay = coroutine_timer::ticks_to_duration(next - start_tick, ticks_per_second);
+				if (next == no_wakeup || delay >= clock::time_point::max() - start_time)
+				{
+					wait_idle(nullptr);
+				}
+				else
+				{
+					clock::time_point deadline = start_time + std::chrono::duration_cast<clock::duration>(delay);
+					wait_idle(&deadline);
+				}
+			}
+		}
+
+		// 让run在本次update后返回，可以在任意线程调用，不在run中时下一次run只执行一次update
+		void stop()
+		{
+			stopping.store(true, std::memory_order_release);
+			io.wake();
+		}
+
+		// 唤醒阻塞在run中的线程，可以在任意线程调用
+		void wake()
+		{
+			io.wake();
+		}
+
+		resume_mode get_resume_mode() const
+		{
+			return resume;
+		}
+
+		size_t get_resume_budget() const
+		{
+			return resume_budget;
+		}
+
+		// cascade时budget为每次update接着恢复的最大数量，防止长依赖链占满一帧
+		void set_resume_mode(resume_mode _mode, size_t budget = std::numeric_limits<size_t>::max())
+		{
+			resume = _mode;
+			resume_budget = budget;
+
+			if (resume != resume_mode::cascade)
+				ready.splice(woken);
+		}
+
+		// 挂入时间轮
+		void add_timer(yield_constructor* constructor, uint64_t deadline)
+		{
+			if (mode == timer_mode::scan)
+			{
+				// 不挂入时间轮，与时间轮一样最早在下一个未处理的tick到期
+				constructor->unlink();
+				constructor->deadline = deadline < timers.get_current() ? timers.get_current() : deadline;
+			}
+			else
+			{
+				timers.schedule(constructor, deadline);
+			}
+
+			set_wait(constructor, coroutine_slot::wait_kind::timer, constructor->deadline);
+		}
+
+		timer_mode get_timer_mode() const
+		{
+			return mode;
+		}
+
+		// 切换定时等待的处理方式，切回时间轮时把扫描中的等待挂入时间轮
+		void set_timer_mode(timer_mode _mode)
+		{
+			if (mode == _mode)
+				return;
+
+			mode = _mode;
+
+			if (mode != timer_mode::wheel)
+				return;
+
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) != coroutine_slot::slot_state::suspended || slots.get_deadline(i) == slot_table::no_deadline)
+					continue;
+
+				yield_constructor* waiting = slots.get_handle(i).promise().constructor;
+				if (waiting != nullptr && !waiting->is_linked())
+					timers.schedule(waiting, slots.get_deadline(i));
+			}
+		}
+
+		// 挂入轮询链表
+		void add_polling(yield_constructor* constructor)
+		{
+			polling.push_back(constructor);
+			set_wait(constructor, coroutine_slot::wait_kind::polling, slot_table::no_deadline);
+		}
+
+		// 挂入就绪队列，条件满足的constructor可随时调用，下一次update时恢复
+		void add_ready(yield_constructor* constructor)
+		{
+			if (constructor->handle == nullptr || constructor->handle.done())
+				return;
+
+			constructor->detach();
+			ready.push_back(constructor);
+			set_wait(constructor, coroutine_slot::wait_kind::ready, slot_table::no_deadline);
+		}
+
+		// 挂入event_id的等待表，超时由之前的add_timer设置
+		void add_event_waiter(int event_id, event_node* node)
+		{
+			event_waiters[event_id].push_back(node);
+			set_wait(node->owner, coroutine_slot::wait_kind::event, node->owner->deadline);
+		}
+
+#if defined COROUTINE_REACTOR
+		// 挂入reactor，没有超时的等待不参与轮询，只由reactor唤醒
+		int add_io_waiter(fd_node* node, bool timed);
+
+		// 等待超时、被取消或销毁时从reactor摘除
+		void remove_io_waiter(fd_node* node)
+		{
+			io.remove(node);
+		}
+
+		// 没有关注中的fd，update时不需要轮询
+		bool io_idle() const
+		{
+			return io.empty();
+		}
+#endif
+
+		// 挂入同步结构的等待链表，只由同步结构唤醒，不需要轮询
+		void add_sync_waiter(coroutine_timer::intrusive_list& waiters, sync_node* node);
+
+		// 同步结构交出值或关闭时唤醒等待者，cascade时在本次update中接着恢复
+		void wake_sync(yield_constructor* constructor)
+		{
+			if (resume == resume_mode::cascade)
+				add_woken(constructor);
+			else
+				add_ready(constructor);
+		}
+
+		// 挂入协程id的依赖链表，协程结束或被删除时通知
+		bool add_dependent(uint64_t id, dependent_node* node)
+		{
+			if (!exists_coroutine(id))
+				return false;
+
+			// 结束时由close_slot通知，不需要轮询
+			node->owner->unlink();
+			dependents[slot_table::index_of(id)].push_back(node);
+			set_wait(node->owner, coroutine_slot::wait_kind::coroutine, slot_table::no_deadline);
+
+			return true;
+		}
+
+		// 触发指定的事件，result不复制，默认只交给最早挂起的等待者
+		void trigger_event(int event_id, void* result, delivery how = delivery::one_shot())
+		{
+			current_scope scope(this);
+
+			dispatch_pointers(event_id, &result, 1, how);
+		}
+
+		// 触发指定的事件，value移入接受事件的等待者，通过wait_for_event::get<T>()取得。
+		// 交给多个等待者时每个等待者得到一份复制，只能移动的值只交给最早挂起的等待者
+		template<typename T, typename = std::enable_if_t<!std::is_pointer_v<std::decay_t<T>> && !std::is_same_v<std::decay_t<T>, coroutine_event::event_payload>>>
+		void trigger_event(int event_id, T&& value, delivery how = delivery::one_shot())
+		{
+			current_scope scope(this);
+
+			dispatch_values<std::decay_t<T>>(event_id, &value, 1, how, !std::is_lvalue_reference_v<T>);
+		}
+
+		// 批量触发同一个事件，results依次交给触发前已挂起的等待者，等待者只查找和遍历一次
+		void trigger_events(int event_id, void** results, size_t count, delivery how = delivery::one_shot())
+		{
+			current_scope scope(this);
+
+			dispatch_pointers(event_id, results, count, how);
+		}
+
+		// 同上，只交给一个等待者的值会被移走
+		template<typename T>
+		void trigger_events(int event_id, T* values, size_t count, delivery how = delivery::one_shot())
+		{
+			current_scope scope(this);
+
+			dispatch_values<std::remove_const_t<T>>(event_id, values, count, how, true);
+		}
+
+		// 同一个result触发多个事件
+		void trigger_events(const int* event_ids, size_t count, void* result, delivery how = delivery::one_shot())
+		{
+			current_scope scope(this);
+
+			for (size_t i = 0; i < count; i++)
+				dispatch_pointers(event_ids[i], &result, 1, how);
+		}
+
+		// 任意线程调用，把value放入收件箱，下一次update开始时触发，不阻塞，收件箱满时返回false
+		// 不超过event_payload::inline_size的值不分配内存
+		template<typename T, typename = std::enable_if_t<!std::is_pointer_v<std::decay_t<T>> && !std::is_same_v<std::decay_t<T>, coroutine_event::event_payload>>>
+		bool post_event(int event_id, T&& value, delivery how = delivery::one_shot())
+		{
+			posted_event posted;
+			posted.event_id = event_id;
+			posted.how = how;
+			posted.payload.emplace<std::decay_t<T>>(std::forward<T>(value));
+
+			return push_posted(std::move(posted));
+		}
+
+		// 任意线程调用，result不复制，调用者保证它在触发前有效
+		bool post_event(int event_id, void* result, delivery how = delivery::one_shot())
+		{
+			posted_event posted;
+			posted.event_id = event_id;
+			posted.how = how;
+			posted.pointer = result;
+
+			return push_posted(std::move(posted));
+		}
+
+		// 创建新协程，绑定到此管理器后开始执行
+		// token为空时继承正在运行的协程绑定的token
+		uint64_t create_coroutine(coroutine_t handler, priority _priority = priority::normal, const cancellation_token& token = cancellation_token())
+		{
+			if (handler.handle == nullptr || handler.handle.done())
+				return (uint64_t)0;
+
+			uint64_t id = slots.allocate(handler.handle);
+			if (id == 0)
+				return (uint64_t)0;
+
+			while (dependents.size() < slots.size())
+			{
+				dependents.emplace_back();
+				cancel_nodes.emplace_back();
+			}
+
+			handler.handle.promise().manager = this;
+			handler.handle.promise().id = id;
+
+			size_t index = slot_table::index_of(id);
+			slots.set_priority(index, _priority);
+			metrics.on_spawn(index);
+			bind_cancellation(index, id, token.valid() ? token : get_running_token());
+
+			current_scope scope(this);
+			running_scope running(this, id);
+
+			handler.handle.resume();
+
+			// 没有挂起就结束或运行中被删除的协程立即回收
+			if (handler.handle.done() || slots.has_flag(index, coroutine_slot::flag_destroy_pending))
+			{
+				release_coroutine(id);
+				return (uint64_t)0;
+			}
+
+			return id;
+		}
+
+		// 删除指定的协程，如果是当前协程，则此协程暂停后删除
+		bool destroy_coroutine(uint64_t id)
+		{
+			if (!slots.contains(id))
+				return false;
+
+			size_t index = slot_table::index_of(id);
+			if (slots.get_state(index) == coroutine_slot::slot_state::running)
+			{
+				slots.set_flag(index, coroutine_slot::flag_destroy_pending);
+				return true;
+			}
+
+			close_slot(index);
+
+			return true;
+		}
+
+		// 协作式取消，挂起的协程从等待结构中摘除后立即以取消状态恢复，
+		// 正在运行的协程在下一次挂起时放入就绪队列
+		bool cancel_coroutine(uint64_t id)
+		{
+			if (!slots.contains(id))
+				return false;
+
+			size_t index = slot_table::index_of(id);
+			if (slots.has_flag(index, coroutine_slot::flag_cancelled))
+				return true;
+
+			slots.set_flag(index, coroutine_slot::flag_cancelled);
+
+			if (slots.get_state(index) != coroutine_slot::slot_state::suspended)
+				return true;
+
+			yield_constructor* constructor = slots.get_handle(index).promise().constructor;
+			if (constructor != nullptr)
+			{
+				current_scope scope(this);
+
+				constructor->cancelled = true;
+				resume_constructor(constructor);
+			}
+
+			return true;
+		}
+
+		// 正在运行的协程id，不在协程中时为0
+		uint64_t get_running_coroutine() const
+		{
+			return running_id;
+		}
+
+		bool is_cancelled(uint64_t id) const
+		{
+			return slots.contains(id) && slots.has_flag(slot_table::index_of(id), coroutine_slot::flag_cancelled);
+		}
+
+		// 协程绑定的取消标记，没有绑定时为空
+		cancellation_token get_cancellation_token(uint64_t id) const
+		{
+			if (!slots.contains(id))
+				return cancellation_token();
+
+			return cancellation_token(cancel_nodes[slot_table::index_of(id)].state);
+		}
+
+		// 统计快照，未定义COROUTINE_METRICS时只有槽位数量有效
+		manager_stats get_stats() const
+		{
+			manager_stats stats;
+			stats.live_coroutines = slots.live_count();
+			stats.free_slots = slots.free_count();
+			stats.ticks_per_second = ticks_per_second;
+			metrics.fill(stats);
+
+			return stats;
+		}
+
+		// 协程的统计，协程不存在或未定义COROUTINE_METRICS时返回false
+		bool get_coroutine_stats(uint64_t id, coroutine_stats& stats) const
+		{
+			if (!slots.contains(id))
+				return false;
+
+			return metrics.get(slot_table::index_of(id), cur_tick, stats);
+		}
+
+		// 对每个存在的协程调用f(id, stats)，未定义COROUTINE_METRICS时不会调用
+		template<typename F>
+		void for_each_coroutine_stats(F&& f) const
+		{
+			coroutine_stats stats;
+
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots.get_state(i) == coroutine_slot::slot_state::free)
+					continue;
+
+				if (metrics.get(i, cur_tick, stats))
+					f(slots.get_handle(i).promise().id, stats);
+			}
+		}
+
+		// 协程句柄，不存在时返回空
+		coroutine_t::handle_type get_coroutine(uint64_t id) const
+		{
+			if (!slots.contains(id))
+				return nullptr;
+
+			return slots.get_handle(slot_table::index_of(id));
+		}
+
+		// 只检查槽位表，不访问协程帧
+		bool exists_coroutine(uint64_t id) const
+		{
+			return slots.contains(id);
+		}
+
+		// 修改优先级，已在运行队列中的等待下一次入队时生效
+		bool set_priority(uint64_t id, priority _priority)
+		{
+			if (!slots.contains(id))
+				return false;
+
+			slots.set_priority(slot_table::index_of(id), _priority);
+			return true;
+		}
+
+		priority get_priority(uint64_t id) const
+		{
+			return slots.contains(id) ? slots.get_priority(slot_table::index_of(id)) : priority::normal;
+		}
+
+	private:
+		typedef coroutine_slot::slot_table<coroutine_t::handle_type> slot_table;
+
+		// 在作用域内把当前线程的管理器设为manager
+		struct current_scope
+		{
+			current_scope(coroutine_manager* manager) : previous(current)
+			{
+				current = manager;
+			}
+
+			~current_scope()
+			{
+				current = previous;
+			}
+
+			coroutine_manager* previous;
+		};
+
+		// 在作用域内记录正在运行的协程id，create_coroutine据此继承取消标记
+		struct running_scope
+		{
+			running_scope(coroutine_manager* _manager, uint64_t id) : manager(_manager), previous(_manager->running_id)
+			{
+				manager->running_id = id;
+				manager->metrics.begin_run(slot_table::index_of(id));
+			}
+
+			~running_scope()
+			{
+				manager->running_id = previous;
+				manager->metrics.end_run(previous != 0 ? slot_table::index_of(previous) : coroutine_metrics::no_index);
+			}
+
+			coroutine_manager* manager;
+			uint64_t previous;
+		};
+
+		cancellation_token get_running_token() const
+		{
+			return get_cancellation_token(running_id);
+		}
+
+		// 绑定取消标记，标记已取消时协程在第一次挂起时以取消状态恢复
+		void bind_cancellation(size_t index, uint64_t id, const cancellation_token& token)
+		{
+			coroutine_cancel::cancel_node& node = cancel_nodes[index];
+			node.manager = this;
+			node.id = id;
+			node.cancel = &cancel_bound;
+
+			if (!token.bind(node))
+				slots.set_flag(index, coroutine_slot::flag_cancelled);
+		}
+
+		static void cancel_bound(void* manager, uint64_t id)
+		{
+			static_cast<coroutine_manager*>(manager)->cancel_coroutine(id);
+		}
+
+		// 恢复挂起在constructor上的协程，结束的协程立即回收
+		void resume_constructor(yield_constructor* constructor)
+		{
+			constructor->detach();
+
+			coroutine_t::handle_type handle = coroutine_t::handle_type::from_address(constructor->handle.address());
+			if (handle == nullptr || handle.done())
+				return;
+
+			uint64_t id = handle.promise().id;
+			if (!slots.contains(id))
+				return;
+
+			size_t index = slot_table::index_of(id);
+			slots.set_state(index, coroutine_slot::slot_state::running);
+			metrics.on_resume(index, cur_tick);
+
+			{
+				running_scope running(this, id);
+				constructor->frame.resume();
+			}
+
+			// 运行中被删除的协程挂起后在此回收
+			if (handle.done() || (slots.contains(id) && slots.has_flag(index, coroutine_slot::flag_destroy_pending)))
+				release_coroutine(id);
+		}
+
+		void release_coroutine(uint64_t id)
+		{
+			if (!slots.contains(id))
+				return;
+
+			close_slot(slot_table::index_of(id));
+		}
+
+		void dispatch_pointers(int event_id, void** results, size_t count, delivery how)
+		{
+			dispatch_waiters(event_id, count, how.consumers, [event_id, results](yield_constructor* constructor, size_t index, bool)
+			{
+				return constructor->trigger(event_id, results[index]);
+			});
+		}
+
+		// movable为true时交给最后一个等待者的值可以移走，等待者不接受时再移回来
+		template<typename T, typename Value>
+		void dispatch_values(int event_id, Value* values, size_t count, delivery how, bool movable)
+		{
+			size_t consumers = std::is_copy_constructible_v<T> ? how.consumers : 1;
+
+			dispatch_waiters(event_id, count, consumers, [event_id, values, movable](yield_constructor* constructor, size_t index, bool last)
+			{
+				coroutine_event::event_payload payload;
+
+				if constexpr (!std::is_const_v<Value>)
+				{
+					if (movable && last)
+					{
+						payload.emplace<T>(std::move(values[index]));
+
+						int res = constructor->trigger(event_id, payload);
+						if constexpr (std::is_move_assignable_v<T>)
+						{
+							if (res <= 0 && payload.has_value())
+								values[index] = std::move(*payload.get<T>());
+						}
+
+						return res;
+					}
+				}
+
+				if constexpr (std::is_copy_constructible_v<T>)
+					payload.emplace<T>(values[index]);
+
+				return constructor->trigger(event_id, payload);
+			});
+		}
+
+		void dispatch_payload(int event_id, coroutine_event::event_payload& payload, delivery how)
+		{
+			size_t consumers = payload.copyable() ? how.consumers : 1;
+
+			dispatch_waiters(event_id, 1, consumers, [event_id, &payload](yield_constructor* constructor, size_t, bool last)
+			{
+				if (last)
+					return constructor->trigger(event_id, payload);
+
+				coroutine_event::event_payload copy = payload.clone();
+				return constructor->trigger(event_id, copy);
+			});
+		}
+
+		// 值依次交给触发前已挂起的等待者，每个值最多交给consumers个。
+		// offer返回-1: 不接受, 0: 已触发, 1: 接受。不接受的等待者保持先后顺序，排在新挂入的前面
+		template<typename Offer>
+		void dispatch_waiters(int event_id, size_t count, size_t consumers, Offer&& offer)
+		{
+			auto it = event_waiters.find(event_id);
+			if (it == event_waiters.end())
+				return;
+
+			coroutine_timer::intrusive_list& waiters = it->second;
+			coroutine_timer::intrusive_list pending;
+			coroutine_timer::intrusive_list skipped;
+			pending.splice(waiters);
+
+			++trigger_depth;
+
+			for (size_t i = 0; i < count && !pending.empty(); i++)
+			{
+				size_t delivered = 0;
+				while (delivered < consumers && !pending.empty())
+				{
+					event_node* node = static_cast<event_node*>(pending.pop_front());
+					yield_constructor* constructor = node->owner;
+
+					int res = offer(constructor, i, delivered + 1 == consumers || pending.empty());
+					if (res < 0)
+					{
+						skipped.push_back(node);
+						continue;
+					}
+
+					if (res == 0)
+						continue;
+
+					++delivered;
+					resume_constructor(constructor);
+				}
+			}
+
+			skipped.splice(pending);
+			skipped.splice(waiters);
+			waiters.splice(skipped);
+
+			// 嵌套触发时外层还持有waiters的引用
+			if (--trigger_depth == 0 && waiters.empty())
+				event_waiters.erase(event_id);
+		}
+
+		// 其他线程投递的事件，有payload时按值触发，否则触发pointer
+		struct posted_event
+		{
+			int event_id{ 0 };
+			delivery how{ delivery::one_shot() };
+			coroutine_event::event_payload payload;
+			void* pointer{ nullptr };
+		};
+
+#if defined COROUTINE_REACTOR
+		void poll_io(int timeout_ms);
+
+		static bool on_io_ready(coroutine_reactor::io_node* node);
+#endif
+
+		// 投递后run正在阻塞时唤醒
+		bool push_posted(posted_event&& posted)
+		{
+			if (!inbox.try_push(std::move(posted)))
+				return false;
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (sleeping.load(std::memory_order_relaxed))
+				io.wake();
+
+			return true;
+		}
+
+		// 收件箱为空时阻塞，sleeping和投递之间的栅栏保证投递者能看到它并唤醒
+		void wait_idle(const std::chrono::steady_clock::time_point* deadline)
+		{
+			sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (inbox.empty() && !stopping.load(std::memory_order_relaxed))
+			{
+#if defined COROUTINE_REACTOR
+				io.wait(deadline, &on_io_ready);
+#else
+				io.wait(deadline);
+#endif
+			}
+
+			sleeping.store(false, std::memory_order_relaxed);
+		}
+
+		// 只处理不超过队列容量的数量，生产者持续投递时update也能返回
+		void drain_inbox()
+		{
+			posted_event posted;
+			for (size_t i = inbox.capacity(); i > 0 && inbox.try_pop(posted); i--)
+			{
+				if (posted.payload.has_value())
+					dispatch_payload(posted.event_id, posted.payload, posted.how);
+				else
+					dispatch_pointers(posted.event_id, &posted.pointer, 1, posted.how);
+			}
+		}
+
+		// 扫描槽位表的deadline列，到期的定时等待放入运行队列
+		void enqueue_expired_slots(uint64_t tick)
+		{
+			expired_slots.clear();
+			coroutine_scan::scan_expired(slots.get_deadlines(), slots.size(), tick, expired_slots);
+
+			for (size_t i = 0; i < expired_slots.size(); i++)
+			{
+				size_t index = expired_slots[i];
+
+				// 前面恢复的协程可能已删除此协程或改变了它的等待
+				if (slots.get_state(index) != coroutine_slot::slot_state::suspended || slots.get_deadline(index) > tick)
+					continue;
+
+				yield_constructor* waiting = slots.get_handle(index).promise().constructor;
+				if (waiting != nullptr)
+					enqueue(waiting);
+			}
+		}
+
+		// 记录constructor所在协程的等待类型
+		void set_wait(yield_constructor* constructor, coroutine_slot::wait_kind kind, uint64_t deadline)
+		{
+			if (constructor->handle == nullptr)
+				return;
+
+			uint64_t id = coroutine_t::handle_type::from_address(constructor->handle.address()).promise().id;
+			if (!slots.contains(id))
+				return;
+
+			size_t index = slot_table::index_of(id);
+
+			// 已取消的协程不再等待，下一次update以取消状态恢复
+			if (kind != coroutine_slot::wait_kind::ready && slots.has_flag(index, coroutine_slot::flag_cancelled))
+			{
+				constructor->cancelled = true;
+				add_ready(constructor);
+				return;
+			}
+
+			metrics.on_wait(index, kind, cur_tick);
+			slots.set_wait(index, kind, deadline);
+		}
+
+		// 按所在协程的优先级放入运行队列，由run_queues恢复
+		void enqueue(yield_constructor* constructor)
+		{
+			constructor->detach();
+
+			if (constructor->handle == nullptr || constructor->handle.done())
+				return;
+
+			uint64_t id = coroutine_t::handle_type::from_address(constructor->handle.address()).promise().id;
+			if (!slots.contains(id))
+				return;
+
+			size_t index = slot_table::index_of(id);
+			metrics.on_wait(index, coroutine_slot::wait_kind::ready, cur_tick);
+			queues[(size_t)slots.get_priority(index)].push_back(constructor);
+			slots.set_wait(index, coroutine_slot::wait_kind::ready, slot_table::no_deadline);
+		}
+
+		// 记录本次update已恢复的数量和用时，时间每check_interval次检查一次
+		class budget_meter
+		{
+		public:
+			static constexpr size_t check_interval = 32;
+
+			explicit budget_meter(const update_budget& budget) : remaining(budget.resumes)
+			{
+				if (budget.time.count() > 0)
+				{
+					timed = true;
+					deadline = std::chrono::steady_clock::now() + budget.time;
+				}
+			}
+
+			// 预算未用完时计入一次恢复并返回true
+			bool take()
+			{
+				if (remaining == 0)
+					return false;
+
+				if (timed && ++counter % check_interval == 0 && std::chrono::steady_clock::now() >= deadline)
+				{
+					remaining = 0;
+					return false;
+				}
+
+				--remaining;
+				return true;
+			}
+
+		private:
+			size_t remaining;
+			size_t counter{ 0 };
+			bool timed{ false };
+			std::chrono::steady_clock::time_point deadline;
+		};
+
+		// 按优先级恢复运行队列，预算用完时返回false
+		bool run_queues(budget_meter& meter)
+		{
+			for (size_t i = 0; i < coroutine_slot::priority_count; i++)
+			{
+				while (!queues[i].empty())
+				{
+					if (!meter.take())
+						return false;
+
+					resume_constructor(static_cast<yield_constructor*>(queues[i].pop_front()));
+				}
+			}
+
+			return true;
+		}
+
+		// 挂入本次update接着恢复的队列
+		void add_woken(yield_constructor* constructor)
+		{
+			if (constructor->handle == nullptr || constructor->handle.done())
+				return;
+
+			constructor->detach();
+			woken.push_back(constructor);
+			set_wait(constructor, coroutine_slot::wait_kind::ready, slot_table::no_deadline);
+		}
+
+		// 关闭槽位上的协程，通知等待它的协程
+		void close_slot(size_t _index)
+		{
+			coroutine_timer::intrusive_list& waiters = dependents[_index];
+
+			while (!waiters.empty())
+			{
+				dependent_node* node = static_cast<dependent_node*>(waiters.pop_front());
+
+				if (node->remaining != nullptr && --(*node->remaining) > 0)
+					continue;
+
+				if (resume == resume_mode::cascade)
+					add_woken(node->owner);
+				else
+					add_ready(node->owner);
+			}
+
+			coroutine_cancel::unbind(cancel_nodes[_index]);
+
+			// 先释放槽位，协程帧析构过程中此id已无效
+			coroutine_t::handle_type handle = slots.get_handle(_index);
+			slots.release(_index);
+
+			if (handle != nullptr)
+				handle.destroy();
+		}
+
+	private:
+		slot_table slots;
+
+		uint64_t cur_tick;
+		uint64_t ticks_per_second;
+		timer_mode mode{ timer_mode::wheel };
+		resume_mode resume{ resume_mode::next_update };
+		size_t resume_budget{ std::numeric_limits<size_t>::max() };
+		// 其他线程投递的事件
+		coroutine_inbox::mpsc_queue<posted_event> inbox;
+		// resume_expired_slots的临时数组
+		std::vector<uint32_t> expired_slots;
+
+		// 定时等待
+		coroutine_timer::timer_wheel timers;
+		// 需要轮询的等待
+		coroutine_timer::intrusive_list polling;
+		// 等待下一次update恢复
+		coroutine_timer::intrusive_list ready;
+		// cascade时在本次update中接着恢复
+		coroutine_timer::intrusive_list woken;
+		// 按优先级排队等待恢复，超出预算的留到下一次update
+		coroutine_timer::intrusive_list queues[coroutine_slot::priority_count];
+		// 每个槽位上等待该协程结束的依赖节点
+		std::deque<coroutine_timer::intrusive_list> dependents;
+		// 每个槽位与取消标记的绑定
+		std::deque<coroutine_cancel::cancel_node> cancel_nodes;
+		// fd就绪通知，run空闲时在此阻塞
+		coroutine_reactor::reactor io;
+		std::atomic<bool> sleeping{ false };
+		std::atomic<bool> stopping{ false };
+		// 正在运行的协程，不在协程中时为0
+		uint64_t running_id{ 0 };
+		// 定义COROUTINE_METRICS时的运行统计，否则为空
+		coroutine_metrics::recorder metrics;
+		// 按event_id索引的事件等待表
+		std::unordered_map<int, coroutine_timer::intrusive_list> event_waiters;
+		unsigned int trigger_depth{ 0 };
+
+		static inline thread_local coroutine_manager* current{ nullptr };
+	};
+
+	// 等待指定的时间
+	class wait_for_seconds : public yield_constructor
+	{
+	public:
+		wait_for_seconds(float seconds) : timeout(coroutine_timer::seconds_to_duration(seconds))
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_seconds(const std::chrono::duration<Rep, Period>& _timeout) : timeout(coroutine_timer::to_duration(_timeout))
+		{
+		}
+
+		void start()
+		{
+			manager->add_timer(this, manager->get_deadline(timeout));
+		}
+
+		bool can_resume() 
+		{
+			return manager->get_tick() >= deadline;
+		}
+
+	private:
+		duration_t timeout;
+	};
+
+	// 等待下一帧
+	class wait_for_frame : public yield_constructor
+	{
+	public:
+		wait_for_frame() 
+		{
+		}
+
+		void start()
+		{
+			manager->add_ready(this);
+		}
+
+		bool can_resume()
+		{
+			return true;
+		}
+	};
+
+	// 等待指定的事件
+	class wait_for_event : public yield_constructor
+	{
+	public:
+		wait_for_event(int _event_id, float seconds) :
+			event_id(_event_id), timeout(coroutine_timer::seconds_to_duration(seconds))
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_event(int _event_id, const std::chrono::duration<Rep, Period>& _timeout) :
+			event_id(_event_id), timeout(coroutine_timer::to_duration(_timeout))
+		{
+		}
+
+		void start()
+		{
+			triggered = false;
+			result = nullptr;
+			payload.reset();
+
+			manager->add_timer(this, manager->get_deadline(timeout));
+
+			event_waiter.owner = this;
+			manager->add_event_waiter(event_id, &event_waiter);
+		}
+
+		virtual void detach() override
+		{
+			yield_constructor::detach();
+			event_waiter.unlink();
+		}
+
+		bool can_resume() 
+		{
+			return manager->get_tick() >= deadline;
+		}
+
+		// 返回-1: 不符, 0: 已触发, 1: 还未触发
+		virtual int trigger(int _event_id, void* _result) override
+		{
+			if (event_id != _event_id)
+				return -1;
+
+			if (triggered)
+				return 0;
+
+			triggered = true;
+			result = _result;
+
+			return 1;
+		}
+
+		// 按值触发，值移入payload，result指向它
+		virtual int trigger(int _event_id, coroutine_event::event_payload& _payload) override
+		{
+			if (event_id != _event_id)
+				return -1;
+
+			if (triggered)
+				return 0;
+
+			triggered = true;
+			payload = std::move(_payload);
+			result = payload.data();
+
+			return 1;
+		}
+
+		// 按值触发的事件值，类型不符或未触发时返回空
+		template<typename T>
+		T* get()
+		{
+			return payload.get<T>();
+		}
+
+		int get_event_id() const
+		{
+			return event_id;
+		}
+
+	private:
+		bool triggered{ false };
+
+		int event_id;
+		duration_t timeout;
+
+		event_node event_waiter;
+
+		coroutine_event::event_payload payload;
+
+	public:
+		void* result{ nullptr };
+	};
+
+	// 等待指定的协程完成
+	class wait_for_coroutine : public yield_constructor
+	{
+	public:
+		wait_for_coroutine(uint64_t _coroutine_id) : coroutine_id(_coroutine_id) 
+		{
+		}
+
+		void start()
+		{
+			waiter.owner = this;
+			if (!manager->add_dependent(coroutine_id, &waiter))
+				manager->add_ready(this);
+		}
+
+		bool can_resume() 
+		{
+			return !manager->exists_coroutine(coroutine_id);
+		}
+
+		virtual void detach() override
+		{
+			yield_constructor::detach();
+			waiter.unlink();
+		}
+
+		uint64_t getcoroutine_id() const 
+		{
+			return coroutine_id;
+		}
+
+	private:
+		uint64_t coroutine_id;
+
+		dependent_node waiter;
+	};
+
+	// 等待指定的协程完成
+	class wait_for_coroutine_group : public yield_constructor
+	{
+	public:
+		wait_for_coroutine_group(uint64_t* _coroutine_group, size_t _count) :
+			wait_coroutine_groups(_coroutine_group), count(_count)
+		{
+		}
+
+		void start()
+		{
+			// 每个仍在运行的协程一个依赖节点，最后一个结束时就绪
+			waiters.resize(count);
+			remaining = 0;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				waiters[i].owner = this;
+				waiters[i].remaining = &remaining;
+
+				if (manager->add_dependent(wait_coroutine_groups[i], &waiters[i]))
+					++remaining;
+			}
+
+			if (remaining == 0)
+				manager->add_ready(this);
+		}
+
+		bool can_resume()
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				if (manager->exists_coroutine(wait_coroutine_groups[i]))
+					return false;
+			}
+
+			return true;
+		}
+
+		virtual void detach() override
+		{
+			yield_constructor::detach();
+
+			for (size_t i = 0; i < waiters.size(); i++)
+				waiters[i].unlink();
+		}
+
+	private:
+		uint64_t* wait_coroutine_groups;
+		size_t count;
+
+		std::vector<dependent_node> waiters;
+		size_t remaining{ 0 };
+	};
+
+	// 等待通道等同步结构，挂入其等待链表，由同步结构唤醒，不参与轮询
+	class sync_constructor : public yield_constructor
+	{
+	public:
+		bool can_resume()
+		{
+			return granted;
+		}
+
+		// 同步结构交出值或已关闭，下一次update恢复，cascade时在本次update中恢复
+		void grant()
+		{
+			granted = true;
+			manager->wake_sync(this);
+		}
+
+		// 按挂起顺序唤醒链表中的全部等待者
+		static void grant_all(coroutine_timer::intrusive_list& waiters)
+		{
+			coroutine_timer::intrusive_list pending;
+			pending.splice(waiters);
+
+			while (!pending.empty())
+				static_cast<sync_node*>(pending.pop_front())->owner->grant();
+		}
+
+		virtual void detach() override
+		{
+			yield_constructor::detach();
+			waiter.unlink();
+		}
+
+	protected:
+		// 挂入同步结构的等待链表
+		void wait_sync(coroutine_timer::intrusive_list& waiters)
+		{
+			granted = false;
+			waiter.owner = this;
+			manager->add_sync_waiter(waiters, &waiter);
+		}
+
+		sync_node waiter;
+		bool granted{ false };
+	};
+
+	template<typename T>
+	class channel;
+
+	// 通道的接收者，发送时值直接交给最早挂起的接收者
+	template<typename T>
+	class channel_receiver : public sync_constructor
+	{
+	public:
+		virtual void deliver(T&& _value) = 0;
+	};
+
+	// 向通道发送一个值，缓冲满时等待，恢复后is_sent()返回是否已发送，通道关闭或被取消时为false
+	template<typename T>
+	class channel_send : public sync_constructor
+	{
+	public:
+		template<typename U>
+		channel_send(channel<T>& _channel, U&& _value) : target(&_channel), value(std::forward<U>(_value))
+		{
+		}
+
+		void start()
+		{
+			sent = target->try_send(std::move(value));
+			if (sent || target->is_closed())
+			{
+				manager->add_ready(this);
+				return;
+			}
+
+			sync_constructor::wait_sync(target->senders);
+		}
+
+		bool is_sent() const
+		{
+			return sent;
+		}
+
+	private:
+		friend class channel<T>;
+
+		// 缓冲空出位置时由通道取走
+		T take()
+		{
+			sent = true;
+			return std::move(value);
+		}
+
+		channel<T>* target;
+		T value;
+		bool sent{ false };
+	};
+
+	// 从通道接收一个值，缓冲空时等待，恢复后get()返回收到的值，通道关闭且缓冲已取完或被取消时为空
+	template<typename T>
+	class channel_receive : public channel_receiver<T>
+	{
+	public:
+		explicit channel_receive(channel<T>& _channel) : target(&_channel)
+		{
+		}
+
+		// 拿到值后还在就绪队列中就被销毁时退回通道
+		~channel_receive()
+		{
+			if (this->is_linked() && value.has_value())
+				target->restore(std::move(*value));
+		}
+
+		void start()
+		{
+			value = target->try_receive();
+			if (value.has_value() || target->is_closed())
+			{
+				this->manager->add_ready(this);
+				return;
+			}
+
+			sync_constructor::wait_sync(target->receivers);
+		}
+
+		virtual void deliver(T&& _value) override
+		{
+			value.emplace(std::move(_value));
+		}
+
+		T* get()
+		{
+			return value.has_value() ? &*value : nullptr;
+		}
+
+	private:
+		channel<T>* target;
+		std::optional<T> value;
+	};
+
+	// 从通道批量接收，至少有一个值时不等待，最多取max_count个追加到output，恢复后get_count()返回取到的数量
+	template<typename T>
+	class channel_receive_many : public channel_receiver<T>
+	{
+	public:
+		channel_receive_many(channel<T>& _channel, std::vector<T>& _output, size_t _max_count) :
+			target(&_channel), output(&_output), max_count(_max_count)
+		{
+			assert(max_count > 0);
+		}
+
+		// 拿到值后还在就绪队列中就被销毁时从output中取回，退回通道
+		~channel_receive_many()
+		{
+			if (!this->is_linked())
+				return;
+
+			for (; count > 0; --count)
+			{
+				target->restore(std::move(output->back()));
+				output->pop_back();
+			}
+		}
+
+		void start()
+		{
+			count = target->try_receive_many(*output, max_count);
+			if (count > 0 || target->is_closed())
+			{
+				this->manager->add_ready(this);
+				return;
+			}
+
+			sync_constructor::wait_sync(target->receivers);
+		}
+
+		virtual void deliver(T&& _value) override
+		{
+			output->push_back(std::move(_value));
+			++count;
+		}
+
+		size_t get_count() const
+		{
+			return count;
+		}
+
+	private:
+		channel<T>* target;
+		std::vector<T>* output;
+		size_t max_count;
+		size_t count{ 0 };
+	};
+
+	// 有界通道，协程之间按发送顺序传递值，缓冲满时发送者等待，空时接收者等待
+	// 有接收者等待时值直接交给最早的接收者，接收后缓冲空出的位置直接由最早等待的发送者填入
+	// 容量为0时不缓冲，发送者等到接收者取走值，先到的一方挂起等待另一方
+	// 任意数量的协程可以同时发送和接收，只能在所属协程管理器的线程使用，析构时不能还有等待者
+	template<typename T>
+	class channel
+	{
+	public:
+		explicit channel(size_t capacity) : buffer(capacity)
+		{
+		}
+
+		channel(const channel&) = delete;
+		channel& operator=(const channel&) = delete;
+
+		// 不等待的发送，缓冲满或已关闭时返回false，此时value不会被移走
+		template<typename U>
+		bool try_send(U&& value)
+		{
+			if (closed)
+				return false;
+
+			// 有接收者等待时缓冲一定为空
+			if (!receivers.empty())
+			{
+				hand_over(T(std::forward<U>(value)));
+				return true;
+			}
+
+			if (buffer.full())
+				return false;
+
+			buffer.push(std::forward<U>(value));
+			return true;
+		}
+
+		// 不等待的接收，缓冲为空时返回空
+		std::optional<T> try_receive()
+		{
+			// 容量为0时直接从最早等待的发送者取值
+			if (buffer.empty())
+			{
+				if (senders.empty())
+					return std::nullopt;
+
+				return std::optional<T>(take_sender());
+			}
+
+			std::optional<T> value(buffer.pop());
+			refill();
+
+			return value;
+		}
+
+		// 最多取max_count个追加到output，返回取到的数量
+		size_t try_receive_many(std::vector<T>& output, size_t max_count)
+		{
+			size_t count = 0;
+
+			while (count < max_count)
+			{
+				if (!buffer.empty())
+				{
+					output.push_back(buffer.pop());
+					refill();
+				}
+				else if (!senders.empty())
+					output.push_back(take_sender());
+				else
+					break;
+
+				++count;
+			}
+
+			return count;
+		}
+
+		// 关闭后不能再发送，等待中的发送者失败，缓冲中的值仍可以接收，取完后接收者为空
+		void close()
+		{
+			closed = true;
+
+			sync_constructor::grant_all(senders);
+			sync_constructor::grant_all(receivers);
+		}
+
+		bool is_closed() const
+		{
+			return closed;
+		}
+
+		size_t size() const
+		{
+			return buffer.size();
+		}
+
+		size_t capacity() const
+		{
+			return buffer.capacity();
+		}
+
+	private:
+		friend class channel_send<T>;
+		friend class channel_receive<T>;
+		friend class channel_receive_many<T>;
+
+		// 缓冲空出位置时移入最早等待的发送者的值，有退回的值时缓冲可能仍是满的
+		void refill()
+		{
+			if (!senders.empty() && !buffer.full())
+				buffer.push(take_sender());
+		}
+
+		// 值直接交给最早等待的接收者
+		void hand_over(T&& value)
+		{
+			channel_receiver<T>* receiver = static_cast<channel_receiver<T>*>(static_cast<sync_node*>(receivers.pop_front())->owner);
+			receiver->deliver(std::move(value));
+			receiver->grant();
+		}
+
+		// 接收者拿到值后没有恢复就被销毁，值交给下一个等待的接收者，没有时放回缓冲头部
+		void restore(T&& value)
+		{
+			if (!receivers.empty())
+				hand_over(std::move(value));
+			else
+				buffer.push_front(std::move(value));
+		}
+
+		// 取走最早等待的发送者的值并唤醒它
+		T take_sender()
+		{
+			channel_send<T>* sender = static_cast<channel_send<T>*>(static_cast<sync_node*>(senders.pop_front())->owner);
+			T value(sender->take());
+			sender->grant();
+
+			return value;
+		}
+
+		coroutine_channel::ring_buffer<T> buffer;
+		bool closed{ false };
+		coroutine_timer::intrusive_list senders;
+		coroutine_timer::intrusive_list receivers;
+	};
+
+#if defined COROUTINE_REACTOR
+	// 等待fd就绪后完成一次非阻塞io，start时先直接尝试，fd需要设为非阻塞
+	// 没有指定超时时一直等待，只由reactor唤醒，不参与轮询
+	class io_constructor : public yield_constructor
+	{
+	public:
+		io_constructor(int _fd, coroutine_reactor::io_event _event, float _seconds) :
+			timeout(coroutine_timer::seconds_to_duration(_seconds < 0.0f ? 0.0f : _seconds)), timed(_seconds >= 0.0f)
+		{
+			io_waiter.fd = _fd;
+			io_waiter.event = _event;
+		}
+
+		template<typename Rep, typename Period>
+		io_constructor(int _fd, coroutine_reactor::io_event _event, const std::chrono::duration<Rep, Period>& _timeout) :
+			timeout(coroutine_timer::to_duration(_timeout)), timed(true)
+		{
+			io_waiter.fd = _fd;
+			io_waiter.event = _event;
+		}
+
+		// 协程被销毁时从reactor中摘除
+		~io_constructor()
+		{
+			if (io_waiter.is_linked())
+				manager->remove_io_waiter(&io_waiter);
+		}
+
+		void start()
+		{
+			completed = try_io(false);
+			if (completed)
+			{
+				manager->add_ready(this);
+				return;
+			}
+
+			if (timed)
+				manager->add_timer(this, manager->get_deadline(timeout));
+
+			io_waiter.owner = this;
+
+			int error = manager->add_io_waiter(&io_waiter, timed);
+			if (error != 0)
+			{
+				result = error;
+				completed = true;
+				manager->add_ready(this);
+			}
+		}
+
+		bool can_resume()
+		{
+			return timed && manager->get_tick() >= deadline;
+		}
+
+		// reactor通知fd就绪时调用，io完成后挂入就绪队列，返回false时继续等待
+		bool on_ready()
+		{
+			if (!try_io(true))
+				return false;
+
+			completed = true;
+			manager->add_ready(this);
+
+			return true;
+		}
+
+		virtual void detach() override
+		{
+			yield_constructor::detach();
+
+			// 超时或被取消时还在等待链表中
+			if (io_waiter.is_linked())
+				manager->remove_io_waiter(&io_waiter);
+		}
+
+		int get_fd() const
+		{
+			return io_waiter.fd;
+		}
+
+		// 没有完成时被取消返回-ECANCELED，超时返回-ETIMEDOUT
+		ssize_t get_result() const
+		{
+			if (completed)
+				return result;
+
+			return is_cancelled() ? -ECANCELED : -ETIMEDOUT;
+		}
+
+	protected:
+		// 执行一次非阻塞io，ready为false时是挂起前的尝试，返回false表示需要等待
+		virtual bool try_io(bool ready) = 0;
+
+		// 记录io的返回值，失败时转为-errno，需要等待时返回false
+		bool set_result(ssize_t _result)
+		{
+			if (_result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				return false;
+
+			result = _result < 0 ? -errno : _result;
+			return true;
+		}
+
+	private:
+		duration_t timeout;
+		bool timed;
+		bool completed{ false };
+		ssize_t result{ 0 };
+
+		fd_node io_waiter;
+	};
+
+	// 等待fd可读
+	class wait_for_readable : public io_constructor
+	{
+	public:
+		wait_for_readable(int _fd, float _seconds = -1.0f) : io_constructor(_fd, coroutine_reactor::io_readable, _seconds)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_readable(int _fd, const std::chrono::duration<Rep, Period>& _timeout) : io_constructor(_fd, coroutine_reactor::io_readable, _timeout)
+		{
+		}
+
+		// 超时、被取消或出错时返回false
+		bool is_ready() const
+		{
+			return get_result() >= 0;
+		}
+
+	protected:
+		virtual bool try_io(bool ready) override
+		{
+			return ready;
+		}
+	};
+
+	// 等待fd可写
+	class wait_for_writable : public io_constructor
+	{
+	public:
+		wait_for_writable(int _fd, float _seconds = -1.0f) : io_constructor(_fd, coroutine_reactor::io_writable, _seconds)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		wait_for_writable(int _fd, const std::chrono::duration<Rep, Period>& _timeout) : io_constructor(_fd, coroutine_reactor::io_writable, _timeout)
+		{
+		}
+
+		// 超时、被取消或出错时返回false
+		bool is_ready() const
+		{
+			return get_result() >= 0;
+		}
+
+	protected:
+		virtual bool try_io(bool ready) override
+		{
+			return ready;
+		}
+	};
+
+	// 读取最多size字节，get_result返回读到的字节数，0表示对端已关闭，失败时返回-errno
+	class async_read : public io_constructor
+	{
+	public:
+		async_read(int _fd, void* _buffer, size_t _size, float _seconds = -1.0f) :
+			io_constructor(_fd, coroutine_reactor::io_readable, _seconds), buffer(_buffer), size(_size)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		async_read(int _fd, void* _buffer, size_t _size, const std::chrono::duration<Rep, Period>& _timeout) :
+			io_constructor(_fd, coroutine_reactor::io_readable, _timeout), buffer(_buffer), size(_size)
+		{
+		}
+
+	protected:
+		virtual bool try_io(bool) override
+		{
+			return set_result(::read(get_fd(), buffer, size));
+		}
+
+	private:
+		void* buffer;
+		size_t size;
+	};
+
+	// 写入最多size字节，get_result返回写入的字节数，可能少于size，失败时返回-errno
+	class async_write : public io_constructor
+	{
+	public:
+		async_write(int _fd, const void* _buffer, size_t _size, float _seconds = -1.0f) :
+			io_constructor(_fd, coroutine_reactor::io_writable, _seconds), buffer(_buffer), size(_size)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		async_write(int _fd, const void* _buffer, size_t _size, const std::chrono::duration<Rep, Period>& _timeout) :
+			io_constructor(_fd, coroutine_reactor::io_writable, _timeout), buffer(_buffer), size(_size)
+		{
+		}
+
+	protected:
+		virtual bool try_io(bool) override
+		{
+			return set_result(::write(get_fd(), buffer, size));
+		}
+
+	private:
+		const void* buffer;
+		size_t size;
+	};
+
+	// 接受一个连接，get_result返回非阻塞的新fd，失败时返回-errno
+	class async_accept : public io_constructor
+	{
+	public:
+		async_accept(int _fd, float _seconds = -1.0f) : io_constructor(_fd, coroutine_reactor::io_readable, _seconds)
+		{
+		}
+
+		template<typename Rep, typename Period>
+		async_accept(int _fd, const std::chrono::duration<Rep, Period>& _timeout) : io_constructor(_fd, coroutine_reactor::io_readable, _timeout)
+		{
+		}
+
+	protected:
+		virtual bool try_io(bool) override
+		{
+			return set_result(::accept4(get_fd(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+		}
+	};
+
+	inline int coroutine_manager::add_io_waiter(fd_node* node, bool timed)
+	{
+		int error = io.add(node);
+		if (error != 0)
+			return error;
+
+		if (!timed)
+			node->owner->unlink();
+
+		set_wait(node->owner, coroutine_slot::wait_kind::io, timed ? node->owner->deadline : slot_table::no_deadline);
+		return 0;
+	}
+
+	inline void coroutine_manager::poll_io(int timeout_ms)
+	{
+		if (io.empty())
+			return;
+
+		io.poll(timeout_ms, &on_io_ready);
+	}
+
+	inline bool coroutine_manager::on_io_ready(coroutine_reactor::io_node* node)
+	{
+		return static_cast<fd_node*>(node)->owner->on_ready();
+	}
+#endif
+
+	inline void coroutine_manager::add_sync_waiter(coroutine_timer::intrusive_list& waiters, sync_node* node)
+	{
+		node->owner->unlink();
+		waiters.push_back(node);
+		set_wait(node->owner, coroutine_slot::wait_kind::sync, slot_table::no_deadline);
+	}
+
+	inline uint64_t get_cur_tick()
+	{
+		return coroutine_manager::get_current()->get_tick();
+	}
+
+	inline coroutine_std::suspend_always coroutine_t::promise_type::yield_value(yield_constructor* _constructor)
+	{
+		return wait_on(_constructor, handle_type::from_promise(*this));
+	}
+
+	inline coroutine_std::suspend_always coroutine_t::promise_type::wait_on(yield_constructor* _constructor, coroutine_std::coroutine_handle<> _frame)
+	{
+		if (_constructor == nullptr)
+			_constructor = &next_frame;
+
+		_constructor->handle = handle_type::from_promise(*this);
+		_constructor->frame = _frame;
+		_constructor->manager = manager;
+		_constructor->cancelled = false;
+
+		manager->add_polling(_constructor);
+		_constructor->start();
+
+		constructor = _constructor;
+
+		return coroutine_std::suspend_always{};
 	}
 }